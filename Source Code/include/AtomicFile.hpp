@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <initializer_list>
+
+enum class CacheReadStatus
+{
+    Loaded,
+    Missing,
+    Corrupt
+};
+
+// Crash safe cache file writes. Contents go to <file>.tmp, are fsynced and then renamed over <file>, a crash leaves either the old or the new file, never a torn one.
+// Optionally appends a BLAKE3 checksum trailer that Read validates and strips, files written before the trailer existed are returned as is.
+class AtomicFile
+{
+public:
+    static bool Write(const std::string& FilePath, std::initializer_list<std::string_view> Parts, bool AppendChecksum = true);
+    // Appends Data and fsyncs before returning, creates the file if needed. For append-only logs, no temp file or trailer
+    static bool Append(const std::string& FilePath, std::string_view Data);
+    static CacheReadStatus Read(const std::string& FilePath, std::string& Contents);
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+
+// Fixed capacity blocking queue used between pipeline stages, a full queue blocks the producer so a fast stage cannot run ahead and buffer a whole source in memory
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t Capacity) : Capacity(Capacity) {}
+
+    // Non-copyable
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Blocks while full, returns false if the queue was closed
+    bool Push(T&& Item)
+    {
+        std::unique_lock<std::mutex> Lock(QueueMutex);
+        NotFull_CV.wait(Lock, [this]() { return Items.size() < Capacity || Closed; });
+        if (Closed)
+        {
+            return false;
+        }
+        Items.push(std::move(Item));
+        Lock.unlock();
+        NotEmpty_CV.notify_one();
+        return true;
+    }
+
+    // Blocks while empty, returns false once the queue is closed and fully drained
+    bool Pop(T& Item)
+    {
+        std::unique_lock<std::mutex> Lock(QueueMutex);
+        NotEmpty_CV.wait(Lock, [this]() { return !Items.empty() || Closed; });
+        if (Items.empty())
+        {
+            return false;
+        }
+        Item = std::move(Items.front());
+        Items.pop();
+        Lock.unlock();
+        NotFull_CV.notify_one();
+        return true;
+    }
+
+    // No more pushes, consumers drain what is left
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> Lock(QueueMutex);
+            Closed = true;
+        }
+        NotEmpty_CV.notify_all();
+        NotFull_CV.notify_all();
+    }
+
+private:
+    std::queue<T> Items;
+    size_t Capacity;
+    bool Closed = false;
+
+    std::mutex QueueMutex;
+    std::condition_variable NotFull_CV;
+    std::condition_variable NotEmpty_CV;
+};
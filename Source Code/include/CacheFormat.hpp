@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+// On-disk layout of <BinID>.bin version 2, read in place through a memory mapping.
+//
+// [CacheFileHeader][CacheRecord x EntryCount][path blob, BlobSize bytes]
+//
+// Records are sorted by path and have a fixed stride so record i is found without parsing the ones before it.
+// Paths are front coded in the blob: every entry stores varint(shared prefix length with the previous path), varint(suffix length), suffix.
+// Every CACHE_RESTART_INTERVAL th entry is a restart point storing its full path(shared = 0), a lookup binary searches the restart
+// points and decodes at most CACHE_RESTART_INTERVAL paths from there.
+// Integers are stored in native byte order, a bin is only read on the machine that wrote it.
+
+constexpr uint32_t CACHE_FILE_MAGIC = 0x4D434344; // "DCCM", never a valid path length of the headerless format
+constexpr uint32_t CACHE_FILE_VERSION = 2;
+constexpr uint32_t CACHE_RESTART_INTERVAL = 16;
+
+constexpr uint8_t CACHE_RECORD_CONTENT_HASHED = 0x01;
+
+struct CacheFileHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint64_t EntryCount;
+    uint64_t LastScanTime;
+    uint64_t BlobSize;
+    uint32_t RecordSize; // sizeof(CacheRecord) of the writer, rejects bins from a build with a different layout
+    uint32_t RestartInterval;
+    std::array<uint8_t, 16> Checksum; // BLAKE3 of everything after the header
+};
+
+struct CacheRecord
+{
+    uint64_t Size;
+    uint64_t MTime;
+    uint64_t CTime;
+    uint64_t Inode;
+    uint64_t PathOffset; // Offset of this entry's front coded path in the blob
+    std::array<uint8_t, 16> Hash;
+    int32_t MissCount;
+    uint8_t Flags;
+    uint8_t Reserved[3];
+};
+
+static_assert(sizeof(CacheFileHeader) == 56, "CacheFileHeader layout changed, bump CACHE_FILE_VERSION");
+static_assert(sizeof(CacheRecord) == 64, "CacheRecord layout changed, bump CACHE_FILE_VERSION");
+static_assert(std::is_trivially_copyable_v<CacheFileHeader> && std::is_trivially_copyable_v<CacheRecord>, "Cache records are read in place from the mapping");
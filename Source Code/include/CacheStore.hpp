@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <future>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include "MetaDataCache.hpp"
+#include "ThreadPool.hpp"
+
+// Process wide cache bin I/O of the sync run, backed by CACHE_IO_THREADS background threads.
+// Prefetch starts loading every source's <BinID>.bin(and replaying its copy journal) while the first sources are already scanning,
+// Acquire hands a source its cache and only waits if that bin is still loading.
+// Save takes a finished source off the copy thread: the stale pass and the serialization run in the background and Done is called
+// there with the result, so journal and copy flag bookkeeping stay ordered after the write. WaitForSaves blocks until every save
+// handed over so far is on disk.
+class CacheStore
+{
+public:
+    // Queues a load for every source in SourceIndex, call after SourceIndex::Build
+    static void Prefetch(const std::vector<std::string>& Sources);
+    // Never null. Loads in the calling thread if the bin was not prefetched
+    static std::shared_ptr<MetaDataCache> Acquire(uint32_t BinID);
+    static void Save(std::shared_ptr<MetaDataCache> Cache, uint32_t BinID, std::function<void(bool)> Done);
+    static void WaitForSaves();
+    // Drains the queue and joins the background threads
+    static void Stop();
+
+private:
+    static std::mutex StoreMutex;
+    static std::condition_variable SavesDoneCV;
+    static std::unique_ptr<ThreadPool> IOPool;
+    static std::unordered_map<uint32_t, std::shared_future<std::shared_ptr<MetaDataCache>>> Prefetched;
+    static size_t PendingSaves;
+
+    static ThreadPool& PoolLocked();
+    static std::shared_ptr<MetaDataCache> LoadSource(uint32_t BinID);
+};
@@ -13,10 +13,16 @@ namespace ConfigGlobal
     extern std::string Mode;
     extern std::string DiskType;
     extern std::string SSDMode;
+    extern std::string ChangeDetection;
+    extern std::string DiffMode;
     extern bool DeleteStaleFromDest;
     extern bool EnableCacheRestoreFromBackup;
     extern bool EnableBackupCopyAfterRun;
     extern bool DestinationTopFolderInsteadOfFullPath;
+    extern bool IOUringScan;
+    extern bool DirectorySkipIndex;
+    extern bool ReflinkCopy;
+    extern bool DropPageCache;
 
     extern unsigned short int MaxLogFiles;
     extern unsigned short int ThreadCount;
@@ -24,6 +30,8 @@ namespace ConfigGlobal
     extern unsigned short int GodSpeedParallelFilesPerSourcesCount;
     extern unsigned short int ParallelFilesPerSourceCount;
     extern unsigned short int StaleEntries;
+    extern unsigned short int ParallelScanThreadCount;
+    extern unsigned short int IOUringQueueDepth;
 
     extern std::filesystem::path DestinationCacheDir;
     extern std::filesystem::path DestinationIndexFileName;
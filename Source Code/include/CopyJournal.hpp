@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+#include "MetaDataCache.hpp"
+
+// Append-only log of per file copy completions, <BinID>.journal next to <BinID>.bin.
+// A record is buffered for every copied file and the buffer is appended + fsynced every JOURNAL_SYNC_RECORDS records or JOURNAL_SYNC_INTERVAL,
+// so a crash loses at most one batch of completions. Replaying the journal over the loaded cache lets the next run or the failure recovery
+// skip every file copied before the crash. The journal is removed once the source's cache has been saved. Thread safe.
+class CopyJournal
+{
+public:
+    CopyJournal() = default;
+    ~CopyJournal();
+
+    // Non-copyable
+    CopyJournal(const CopyJournal&) = delete;
+    CopyJournal& operator=(const CopyJournal&) = delete;
+
+    void Record(uint32_t BinID, const FileInfo& File);
+    void Flush();
+    // Source cache saved, drops pending records and deletes the journal
+    void Discard(uint32_t BinID);
+
+    // Applies every intact record to Cache, stops at a torn or corrupt tail and truncates the journal to the last intact record so
+    // this run can append to it. Returns the number of records applied
+    static size_t Replay(uint32_t BinID, MetaDataCache& Cache);
+    static void Remove(uint32_t BinID);
+
+private:
+    std::mutex JournalMutex;
+    std::unordered_map<uint32_t, std::string> Pending;
+    size_t PendingRecords = 0;
+    std::chrono::steady_clock::time_point LastSync = std::chrono::steady_clock::now();
+
+    void FlushLocked();
+    static std::string JournalPath(uint32_t BinID);
+};
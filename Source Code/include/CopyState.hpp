@@ -0,0 +1,31 @@
+#pragma once
+
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+// Process wide "source fully copied" flags of the current destination, persisted in State.bin.
+// Held in memory under one lock. MarkCopied writes State.bin at most once per COPY_STATE_FLUSH_INTERVAL, the rest is coalesced into the
+// next write or the Flush at the end of the run. A flag lost in a crash only makes recovery revisit a source whose cache is already saved,
+// so it finds nothing to copy. Resetting the flags is written through, a stale "copied" would make recovery skip a source.
+class CopyState
+{
+public:
+    static bool Load();
+    // Every known source back to not copied, on disk before returning
+    static bool ResetAll();
+    static void MarkCopied(uint32_t BinID);
+    static bool IsCopied(uint32_t BinID);
+    // Writes pending updates, no-op when nothing changed since the last write
+    static bool Flush();
+
+private:
+    static std::mutex StateMutex;
+    static std::unordered_map<uint32_t, bool> IDCopiedFlag;
+    static bool Dirty;
+    static std::chrono::steady_clock::time_point LastWrite;
+
+    static bool LoadLocked();
+    static bool WriteLocked();
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+// Excludes compiled once per scan and matched against the scanner's own paths without re-absolutizing.
+// Absolute excludes go into a trie keyed on path components, anything under an excluded path is excluded as well.
+// Name patterns(no separator) match the last component of the path:
+//   Thumbs.db      exact name
+//   *.tmp          extension, hashed lookup
+//   cache_*        glob with * and ?
+//   node_modules/  trailing separator restricts the pattern to directories
+class ExcludeMatcher
+{
+public:
+    ExcludeMatcher() = default;
+
+    void Compile(const std::vector<std::string>& Excludes);
+    bool Empty() const;
+    bool Matches(std::string_view Path, bool IsDirectory) const;
+
+    // True when the exclude is a name pattern rather than a path
+    static bool IsNamePattern(std::string_view Exclude);
+
+private:
+    struct StringHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view Value) const { return std::hash<std::string_view>{}(Value); }
+    };
+    using StringSet = std::unordered_set<std::string, StringHash, std::equal_to<>>;
+
+    struct TrieNode
+    {
+        std::unordered_map<std::string, size_t, StringHash, std::equal_to<>> Children;
+        bool Terminal = false;
+    };
+
+    struct NamePatterns
+    {
+        StringSet Names;
+        StringSet Extensions;
+        std::vector<std::string> Globs;
+
+        bool Empty() const { return Names.empty() && Extensions.empty() && Globs.empty(); }
+        bool Matches(std::string_view Name) const;
+    };
+
+    std::vector<TrieNode> Trie; // Trie[0] is the root
+    NamePatterns AnyPatterns;
+    NamePatterns DirectoryPatterns;
+
+    void AddPath(std::string_view Path);
+    void AddNamePattern(std::string_view Pattern);
+    bool MatchesTrie(std::string_view Path) const;
+
+    static bool GlobMatch(std::string_view Pattern, std::string_view Name);
+};
@@ -1,8 +1,18 @@
 #pragma once
 
 #include <string>
+#include <functional>
+#include <cstdint>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <utility>
 #include "Logger.hpp"
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
 class FileCopier
 {
 public:
@@ -11,6 +21,8 @@ public:
 #else
     static bool CopyFileRangeSupported;
     static void CheckCopyFileRangeSupport();
+    // Bytes moved by each copy tier during the run
+    static void LogCopyStats();
 #endif
 
     static bool PerformFileCopy(const std::string& sourcePath, const std::string& SourceTopRootPath);
@@ -21,4 +33,39 @@ private:
     static std::string SanitizePath(const std::string& absPath);
     static std::wstring EscapeRootDriveForCmd(const std::wstring& path);
     static void HandleCopyFailure(const std::string& FilePath, const std::string& Reason, int ErrorCode);
+
+#ifndef _WIN32
+    // Called with bytes copied so far and the total after every chunk, returning false cancels the copy
+    using CopyProgress = std::function<bool(uint64_t, uint64_t)>;
+
+    enum class CopyTier { CopyFileRange, SendFile, ReadWrite, Reflink };
+    static std::atomic<uint64_t> TierBytes[4];
+    static std::atomic<uint64_t> HoleBytes; // Holes of sparse sources left unallocated in the destination
+
+    struct CopyOutcome
+    {
+        uint64_t Length = 0; // Logical size of the copy, less than the source size only if the source shrank
+        uint64_t DataBytes = 0; // Bytes actually moved, less than Length for sparse files
+    };
+
+    // (source device, destination device) -> whether FICLONE works between them, decided by the first copy of each pair
+    static std::mutex ReflinkMutex;
+    static std::map<std::pair<dev_t, dev_t>, bool> ReflinkPairs;
+
+    // Clones the whole source into the empty destination when ReflinkCopy is enabled and the device pair supports it.
+    // False leaves the destination untouched for a regular copy
+    static bool TryReflink(int srcFd, int destFd, const struct stat& srcStat);
+
+    // Copies the contents of srcFd(at offset 0) into the empty destFd, holes of sparse files included.
+    // Returns 0 or the errno of the step named in failedStep
+    static int CopyContents(int srcFd, int destFd, const struct stat& srcStat, const CopyProgress& progress, std::string& failedStep, CopyOutcome& outcome);
+    // One contiguous range through the copy tiers starting at tier, which is moved down for the rest of the file when a tier is unsupported
+    static int CopyRange(int srcFd, int destFd, uint64_t length, CopyTier& tier, std::string& failedStep, uint64_t& moved);
+
+    // In process copy of files above LARGE_FILE_THRESHOLD: contents, ownership, mode and timestamps, synced to disk.
+    // Returns 0 or the errno of the step named in failedStep
+    static int CopyLargeFile(int srcFd, int destFd, const struct stat& srcStat, const CopyProgress& progress, std::string& failedStep, CopyOutcome& outcome);
+    static int CopyMetadata(int destFd, const struct stat& srcStat);
+    static void LogSparseCopy(const std::string& sourcePath, const CopyOutcome& outcome);
+#endif
 };
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include <vector>
 #include <cstdint>
+#include <functional>
+#include "ThreadPool.hpp"
 #include "MetaDataCache.hpp"
 #include "ConfigGlobal.hpp"
 
@@ -9,8 +11,15 @@ class FileHasher
 {
 public:
     void HashFiles(std::vector<FileInfo>& files);
+    void HashFiles(std::vector<FileInfo>& files, bool content);
     void HashSingleFile(FileInfo& file);
+    void HashSingleFile(FileInfo& file, bool content);
+    void HashFileContent(FileInfo& file);
+
+    // Runs Body over [0, Count) on the shared hashing pool, the calling thread takes part
+    static void ParallelFor(size_t Count, size_t Grain, std::function<void(size_t, size_t)> Body);
 
 private:
-    size_t ThreadCount = ConfigGlobal::ThreadCount;
+    static size_t SharedPoolThreadCount();
+    static ThreadPool& SharedPool();
 };
\ No newline at end of file
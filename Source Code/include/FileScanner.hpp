@@ -2,15 +2,44 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <filesystem>
+#include <functional>
+#include <cstdint>
+
+#include "ExcludeMatcher.hpp"
+#include "PathArena.hpp"
+
+#ifdef __linux__
+class IOUringStatx;
+#endif
 
 struct ScannedFileInfo
 {
-    std::string RelativePath;
+    uint32_t DirID = 0; // Parent directory in the scanner's PathArena
+    std::string_view Name; // File name, stored in the same arena(full path = GetPaths().Join(DirID, Name))
     uintmax_t Size = 0;
     uint64_t MTime = 0;
+    uint64_t CTime = 0; // Inode change time and inode number, only filled by the Linux statx scanner(0 = unknown)
+    uint64_t Inode = 0;
+};
+
+// Directory listing remembered between runs(DirectorySkipIndex), Type is the raw d_type of the entry
+struct DirectoryChild
+{
+    std::string Name;
+    uint8_t Type = 0;
+};
+
+struct DirectoryRecord
+{
+    uint64_t MTime = 0;
+    std::vector<DirectoryChild> Children;
 };
 
+using DirectoryIndex = std::unordered_map<std::string, DirectoryRecord>;
+using DirectoryRecordList = std::vector<std::pair<std::string, DirectoryRecord>>;
+
 class FileScanner
 {
 public:
@@ -22,12 +51,39 @@ public:
     void SetExcludes(const std::vector<std::string>& ExcludePaths);
 
     const std::vector<ScannedFileInfo>& GetFiles() const;
+    // Directory and name storage of the scanned files, valid until Clear()
+    const PathArena& GetPaths() const;
+
+    void SetBatchCallback(size_t Size, std::function<void(std::vector<ScannedFileInfo>&&)> Callback);
+    void SetPreviousDirectoryIndex(DirectoryIndex&& Previous);
+    const DirectoryRecordList& GetDirectoryRecords() const;
 
 private:
     std::vector<ScannedFileInfo> Files;
-    std::vector<std::string> Excludes;
+    ExcludeMatcher Excludes;
+    mutable PathArena Paths; // Filled by the (const) per directory scan functions, from every parallel worker
+
+    mutable DirectoryIndex PreviousDirRecords; // Each directory is visited once, its cached child list is moved into the new index
+    DirectoryRecordList DirRecords;
+    int64_t ScanStartTime = 0;
+
+    size_t BatchSize = 0;
+    std::function<void(std::vector<ScannedFileInfo>&&)> BatchCallback;
 
     void ScanDirectoryIterative(const std::filesystem::path& Root);
+    void ScanDirectoryParallel(const std::filesystem::path& Root, size_t WorkerCount);
+    void FlushBatch(std::vector<ScannedFileInfo>& Out, size_t MinSize) const;
+    void ScanSingleDirectory(const std::filesystem::path& Current, std::vector<std::filesystem::path>& SubDirs, std::vector<ScannedFileInfo>& Out, DirectoryRecordList& DirsOut) const;
+
+#ifdef __linux__
+public:
+    static bool StatxSupported;
+    static void CheckStatxSupport();
+
+private:
+    void ScanSingleDirectoryRaw(const std::filesystem::path& Current, std::vector<std::filesystem::path>& SubDirs, std::vector<ScannedFileInfo>& Out, DirectoryRecordList& DirsOut) const;
+    static IOUringStatx* GetThreadIOUring();
+#endif
 
-    bool IsExcluded(const std::filesystem::path& Path) const;
+    bool IsExcluded(const std::filesystem::path& Path, bool IsDirectory) const;
 };
@@ -7,13 +7,18 @@
 #include <thread>
 #include <atomic>
 #include <utility>
+#include <unordered_map>
+#include <memory>
 #include "MetaDataCache.hpp"
+#include "CopyJournal.hpp"
 #include "Logger.hpp"
 
 struct CopyTask
 {
     std::queue<FileInfo> FileQueue;
-    std::vector<FileInfo> FreshFiles;
+    std::string SourceRoot; // Source top level directory, resolved once per batch from SourceIndex
+    bool FinalBatch = true; // Sources arrive in several batches, only the last one closes the source
+    std::shared_ptr<MetaDataCache> SourceCache; // The source's loaded cache, every copied file is moved into it and it is saved once the source is done
 };
 
 class HDDCopyQueue
@@ -29,7 +34,7 @@ public:
     void Start();
     void Stop();
 
-    void SubmitCopyQueue(uint32_t BinID, std::queue<FileInfo>&& queue, std::vector<FileInfo>&& freshFiles);
+    void SubmitCopyQueue(uint32_t BinID, std::queue<FileInfo>&& queue, bool finalBatch = true, std::shared_ptr<MetaDataCache> sourceCache = nullptr);
     void IncrementPendingSources();
     void DecrementPendingSources();
     void MarkAllSourcesSubmitted();
@@ -38,7 +43,8 @@ public:
 private:
     void CopyThreadLoop();
 
-    MetaDataCache HDDCopyStateCache;
+    CopyJournal Journal;
+    std::unordered_map<uint32_t, size_t> HDDFailedPerSource; // Copy thread only, failures seen in earlier batches of a source
 
     std::queue<std::pair<uint32_t, CopyTask>> HDDGlobalCopyQueue;
     std::mutex HDDCQ_Mutex;
@@ -0,0 +1,54 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <sys/stat.h>
+#include <linux/io_uring.h>
+
+// Minimal io_uring wrapper(raw syscalls, no liburing dependency) used by the scanner to submit a directory's worth of statx calls in one batch.
+// One ring per scanning thread, not thread safe.
+class IOUringStatx
+{
+public:
+    explicit IOUringStatx(unsigned QueueDepth);
+    ~IOUringStatx();
+
+    // Non-copyable
+    IOUringStatx(const IOUringStatx&) = delete;
+    IOUringStatx& operator=(const IOUringStatx&) = delete;
+
+    bool IsValid() const;
+
+    // Runs statx(DirFd, Names[i]) for every name, Errors[i] = 0 on success or -errno
+    // Returns false if the ring itself failed, caller should fall back to synchronous statx for the whole batch.
+    // A ring that failed mid batch is closed, IsValid is false from then on
+    bool StatxBatch(int DirFd, const std::vector<const char*>& Names, int Flags, unsigned Mask, std::vector<struct statx>& Results, std::vector<int>& Errors);
+
+private:
+    int RingFd = -1;
+    unsigned SQEntries = 0;
+
+    void* SQRingPtr = nullptr;
+    void* CQRingPtr = nullptr;
+    size_t SQRingSize = 0;
+    size_t CQRingSize = 0;
+    io_uring_sqe* SQEs = nullptr;
+    size_t SQEsSize = 0;
+
+    unsigned* SQTail = nullptr;
+    unsigned* SQMask = nullptr;
+    unsigned* SQArray = nullptr;
+    unsigned* CQHead = nullptr;
+    unsigned* CQTail = nullptr;
+    unsigned* CQMask = nullptr;
+    io_uring_cqe* CQEs = nullptr;
+
+    int Enter(unsigned ToSubmit, unsigned MinComplete);
+    void DrainAndClose(unsigned InFlight);
+    void Close();
+};
+
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Read only memory mapping of a whole file, the mapping stays valid until Close() or destruction
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    // Non-copyable
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns false if the file is missing, empty or cannot be mapped
+    bool Open(const std::string& FilePath);
+    void Close();
+
+    bool IsOpen() const;
+    const uint8_t* Data() const;
+    size_t Size() const;
+
+private:
+    const uint8_t* MappedData = nullptr;
+    size_t MappedSize = 0;
+
+#ifdef _WIN32
+    void* FileHandle = nullptr;
+    void* MappingHandle = nullptr;
+#endif
+};
@@ -6,10 +6,15 @@
 #include <vector>
 #include <array>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
 #include <cstdint>
+#include <string_view>
 
 #include "FileScanner.hpp"
 #include "Logger.hpp"
+#include "MappedFile.hpp"
+#include "CacheFormat.hpp"
 
 struct FileInfo
 {
@@ -17,12 +22,33 @@ struct FileInfo
     uint64_t Size = 0;
     uint64_t MTime = 0;
     std::array<uint8_t, 16> Hash{};
+    uint64_t CTime = 0;
+    uint64_t Inode = 0;
+    bool ContentHashed = false; // Hash is of the file contents(Content mode or Hybrid content check) rather than of path + size + mtime
     bool Visited = false;
     int MissCount = 0;
     //Can use Bitfields if you are adventurous enough(not using currently because saving 3 bytes per entry is not something I want to deal with)
     //Not to mention that since the string is not of fixed length, the rounding off during byte allocation may cause loss of bits
 };
 
+enum class CacheMatch
+{
+    New, // Not in the cache(or dropped as stale)
+    Changed, // Cached with a different hash
+    Unchanged
+};
+
+// The parts of a cached entry Hybrid change detection decides on, read in place without decoding the path
+struct CachedAttributes
+{
+    uint64_t Size = 0;
+    uint64_t MTime = 0;
+    uint64_t CTime = 0;
+    uint64_t Inode = 0;
+    std::array<uint8_t, 16> Hash{};
+    bool ContentHashed = false;
+};
+
 class MetaDataCache
 {
 public:
@@ -30,41 +56,82 @@ public:
     MetaDataCache() = default;
     explicit MetaDataCache(const std::string& cacheFilePath);
 
-    void UpdateCacheForSource(const std::string& sourcePath, const std::vector<ScannedFileInfo>& scannedFiles);
-    void LoadIndex(std::unordered_map<std::string, uint32_t>& PathToID, std::unordered_map<uint32_t, std::string>& IDToPath);
+    void ScanAndSyncSource(const std::string& sourcePath, const std::vector<std::string>& excludes);
     void MarkVisited(const std::string& path);
+    // Diff lookup: compares the hash with the cached entry and marks it visited in a single probe, safe to call from many threads at once.
+    // An unchanged file whose other metadata moved(inode, ctime, mtime in Content mode) has its cached record refreshed in the same probe
+    CacheMatch ClassifyAndMarkVisited(const FileInfo& file);
+    // Same single probe for a file that is not hashed yet: marks it visited and copies out its cached attributes, false if it is not cached
+    bool VisitAttributes(std::string_view path, CachedAttributes& attributes);
+    // Diffs the whole scan(sorted by path) against the cache in one ordered pass and applies the stale policy to cached entries
+    // the scan did not contain. RemoveStaleEntries is a no-op afterwards until the next Load/Save
+    std::vector<CacheMatch> MergeJoin(const std::vector<FileInfo>& sortedFiles, int maxMissCount);
 
     bool Load(uint32_t MetaDataCacheBinFileNumber);
     bool Save(uint32_t MetaDataCacheBinFileNumber);
-    bool LoadCopiedState();
-    bool SaveCopiedState();
 
     bool HasEntry(const std::string& path) const;
     void UpdateEntry(const std::string& path, const FileInfo& info);
+    // Takes over the record, nothing is stored when the mapped entry already matches it
+    void UpdateEntry(FileInfo&& info);
 
-    void ResetCopiedFlags();
     void RemoveStaleEntries(int maxMissCount);
 
-    void MarkCopied(uint32_t sourceId);
-    bool IsCopied(uint32_t sourceId) const;
-    
-    const std::unordered_map<uint32_t, bool>& GetCopiedMap() const;
     std::unordered_map<std::string, FileInfo> GetAllEntries() const;
     FileInfo GetEntry(const std::string& path) const;
     uint32_t GetOrAddDestinationID();
-    std::string GetPathFromSourceID(uint32_t sourceID);
+
+    uint64_t GetLastScanTime() const;
+    void SetLastScanTime(uint64_t ScanTime);
+
+    bool LoadDirectoryIndex(uint32_t MetaDataCacheBinFileNumber, DirectoryIndex& Records);
+    bool SaveDirectoryIndex(uint32_t MetaDataCacheBinFileNumber, const DirectoryRecordList& Records);
 
 private:
-    
-    mutable std::mutex MetaCacheMutex;
+
+    static constexpr size_t ENTRY_SHARD_COUNT = 64;
+    // Keys view the AbsolutePath of their own FileInfo, every path is stored once. Entries only ever get in through InsertEntry,
+    // and an entry's AbsolutePath is never reassigned while it is in the map
+    using EntryMap = std::unordered_map<std::string_view, FileInfo>;
+    struct EntryShard
+    {
+        std::mutex ShardMutex;
+        EntryMap Entries;
+    };
+
+    // Per path operations hold MetaCacheMutex shared plus the lock of the path's shard, so lookups of different paths run in parallel.
+    // Whole cache operations(Load, Save, RemoveStaleEntries, GetAllEntries) hold it exclusively
+    mutable std::shared_mutex MetaCacheMutex;
 
     std::string CacheFilePath;
 
-    std::unordered_map<std::string, FileInfo> Entries;
-    std::unordered_map<uint32_t, bool> IDCopiedFlag;
+    // Entries loaded from a version 2 bin stay in the mapping, only per entry flags live in memory
+    MappedFile BaseFile;
+    const CacheRecord* BaseRecords = nullptr;
+    const uint8_t* BaseBlob = nullptr;
+    size_t BaseCount = 0;
+    std::vector<std::atomic<uint8_t>> BaseState; // BASE_VISITED / BASE_OVERRIDDEN / BASE_REMOVED per base record
+    std::vector<int32_t> BaseMissCount; // Filled by RemoveStaleEntries, empty = use the mapped MissCount
+
+    // Entries added or updated this run, plus everything read from a version 1 or headerless bin, sharded by path hash
+    mutable std::array<EntryShard, ENTRY_SHARD_COUNT> Shards;
+    uint64_t LastScanTime = 0; // Start of the scan that produced this bin, 0 = unknown(headerless bin)
+    bool StaleResolved = false; // Set by MergeJoin, missing entries were already counted
 
     void EnsureCacheDirExists();
+    bool LoadLocked(uint32_t MetaDataCacheBinFileNumber);
+    bool LoadMapped(const std::string& FilePath);
+    bool LoadStream(const std::string& FilePath);
+    void CloseBase();
+    EntryShard& ShardOf(std::string_view path) const;
+    static void InsertEntry(EntryShard& shard, FileInfo&& info);
+    void RefreshBase(EntryShard& shard, size_t index, const FileInfo& file);
+    size_t EntryCount() const;
+    void DropStale(const std::string& path);
+    void MissBaseEntry(size_t index, const std::string& path, int maxMissCount);
+    size_t FindBase(std::string_view path) const;
+    void DecodeBasePath(size_t index, std::string& path) const;
+    FileInfo BaseEntry(size_t index, std::string path) const;
     void LoadDestinationIndex(std::unordered_map<std::string, uint32_t>& PathToID, std::unordered_map<uint32_t, std::string>& IDToPath);
     void SaveDestinationIndex(const std::unordered_map<std::string, uint32_t>& PathToID);
-    void SaveIndex(const std::unordered_map<std::string, uint32_t>& PathToID);
 };
\ No newline at end of file
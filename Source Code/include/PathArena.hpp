@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+#include <cstddef>
+
+// Path storage of one source scan. Every directory path is stored once and identified by a DirID, file names are appended to large
+// chunks, so a scanned file is (DirID, Name) instead of a heap allocated absolute path of its own.
+// Thread safe, DirIDs and the returned views stay valid until Clear()
+class PathArena
+{
+public:
+    PathArena() = default;
+
+    // Non-copyable
+    PathArena(const PathArena&) = delete;
+    PathArena& operator=(const PathArena&) = delete;
+
+    // Returns the existing DirID if the directory was interned before
+    uint32_t InternDirectory(std::string_view DirPath);
+    std::string_view StoreName(std::string_view Name);
+
+    // Absolute path of a file, DirPath + separator + Name
+    std::string Join(uint32_t DirID, std::string_view Name) const;
+
+    size_t DirectoryCount() const;
+    size_t NameBytes() const;
+    void Clear();
+
+private:
+    mutable std::shared_mutex DirMutex;
+    std::deque<std::string> Directories; // Indexed by DirID, deque so the map keys below stay valid while it grows
+    std::unordered_map<std::string_view, uint32_t> DirectoryIDs;
+
+    mutable std::mutex NameMutex;
+    std::vector<std::unique_ptr<char[]>> Chunks;
+    size_t ChunkUsed = 0;
+    size_t ChunkCapacity = 0;
+    size_t StoredBytes = 0;
+};
@@ -14,6 +14,7 @@
 
 #include "ThreadPool.hpp"
 #include "MetaDataCache.hpp"
+#include "CopyJournal.hpp"
 #include "Logger.hpp"
 
 enum class SSDMode
@@ -39,10 +40,10 @@ inline SSDMode ToSSDMode(const std::string& modeStr)
 
 struct SourceCopyStatus
 {
-    std::atomic<bool> SmallDone{ false };
-    std::atomic<bool> LargeDone{ false };
+    size_t PendingQueues = 0; // Small + large queue of every submitted batch not yet done, guarded by SSDQueueMutex
+    bool FinalSubmitted = false;
     std::mutex Mutex;
-    std::vector<FileInfo> FreshFiles;
+    std::shared_ptr<MetaDataCache> SourceCache; // Source's loaded cache, every copied file is moved into it and it is saved once the source is done
 };
 
 class SSDCopyQueue
@@ -57,7 +58,7 @@ public:
     void Stop();
     void WaitUntilDone();
 
-    void SubmitCopyQueues(uint32_t sourceID, std::queue<FileInfo>&& smallFiles, std::queue<FileInfo>&& largeFiles, std::vector<FileInfo> freshFiles);
+    void SubmitCopyQueues(uint32_t sourceID, std::queue<FileInfo>&& smallFiles, std::queue<FileInfo>&& largeFiles, bool finalBatch = true, std::shared_ptr<MetaDataCache> sourceCache = nullptr);
 
     void IncrementPendingSources();
     void DecrementPendingSources();
@@ -66,7 +67,7 @@ public:
 private:
     
     SSDMode CopyMode;
-    MetaDataCache SSDCopyStateCache;
+    CopyJournal Journal;
 
     //Small File Queue
     std::unique_ptr<ThreadPool> SmallFileThreadPool;
@@ -91,6 +92,7 @@ private:
     std::unordered_map<uint32_t, SourceCopyStatus> SSDSourceStatusMap;
 
     void LargeFileWorker();
-    void ProcessSmallFiles(uint32_t sourceID, std::queue<FileInfo>&& files);
-    void MarkQueueDoneAndCheck(uint32_t sourceID, bool isSmallQueue);
+    void ProcessSmallFiles(uint32_t sourceID, const std::string& sourceRoot, const std::shared_ptr<MetaDataCache>& sourceCache, std::queue<FileInfo>&& files);
+    void RecordCopied(uint32_t sourceID, MetaDataCache* sourceCache, FileInfo&& file);
+    void MarkQueueDoneAndCheck(uint32_t sourceID);
 };
\ No newline at end of file
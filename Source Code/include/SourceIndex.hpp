@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Process wide source path <-> BinID mapping persisted in Index.bin.
+// Loaded(and extended with new sources) once before any source is synced and read only afterwards, so lookups from the scan and copy
+// threads take no lock and never touch the disk. References returned by PathOf stay valid for the rest of the run.
+class SourceIndex
+{
+public:
+    // Loads Index.bin without adding anything, used by the failure recovery
+    static void Load();
+    // Loads Index.bin, assigns BinIDs to sources never seen before and persists them in a single write
+    static void Build(const std::vector<std::string>& Sources);
+
+    static uint32_t IDOf(const std::string& SourcePath); // 0 if the source is not in the index
+    static const std::string& PathOf(uint32_t BinID); // Empty if the BinID is not in the index
+
+private:
+    static std::unordered_map<std::string, uint32_t> PathToID;
+    static std::unordered_map<uint32_t, std::string> IDToPath;
+
+    static void Save();
+};
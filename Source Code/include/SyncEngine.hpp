@@ -2,7 +2,9 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include "MetaDataCache.hpp"
+#include "FileHasher.hpp"
 #include "HDDCopyQueue.hpp"
 #include "SSDCopyQueue.hpp"
 
@@ -12,10 +14,27 @@ public:
 
     static void SetHDDCopyQueue(HDDCopyQueue* manager);
     static void SetSSDCopyQueue(SSDCopyQueue* manager);
-    static void Sync(std::vector<FileInfo> freshFiles,MetaDataCache& cache, uint32_t MetaDataCacheBinFileNumber);
+
+    // ChangeDetection = Hybrid, reuses the cached hash where metadata can be trusted and content hashes only the ambiguous files.
+    // Marks every file visited and returns its diff against the cache, only the content hashed files are looked up a second time
+    static std::vector<CacheMatch> ResolveHybridHashes(std::vector<FileInfo>& batchFiles, MetaDataCache& cache, uint64_t previousScanTime, uint64_t currentScanTime, FileHasher& hasher);
+    // Looks every file of the batch up in the cache in parallel and marks it visited
+    static std::vector<CacheMatch> ClassifyBatch(const std::vector<FileInfo>& batchFiles, MetaDataCache& cache);
+    // Diffs one batch of hashed files against the cache and moves the changed ones into the copy queue, returns true if anything was submitted
+    static bool SyncBatch(std::vector<FileInfo>& batchFiles, const std::shared_ptr<MetaDataCache>& cache, uint32_t MetaDataCacheBinFileNumber);
+    // Same for a batch ResolveHybridHashes already classified
+    static bool SyncBatch(std::vector<FileInfo>& batchFiles, const std::vector<CacheMatch>& matches, const std::shared_ptr<MetaDataCache>& cache, uint32_t MetaDataCacheBinFileNumber);
+    // DiffMode = MergeJoin, sorts the whole scan by path and diffs it against the cache in one pass, missing files are handled in the same pass
+    static bool SyncSorted(std::vector<FileInfo>& files, const std::shared_ptr<MetaDataCache>& cache, uint32_t MetaDataCacheBinFileNumber);
+    // Closes the source once every batch went through SyncBatch, the copy queue saves the cache after the last copy
+    static void FinishSource(std::shared_ptr<MetaDataCache> cache, uint32_t MetaDataCacheBinFileNumber, bool anySubmitted);
 
 private:
 
+    static void SortByPath(std::vector<FileInfo>& files);
+    // Queues every file not classified Unchanged for copying, returns true if anything was submitted
+    static bool SubmitChanged(std::vector<FileInfo>& batchFiles, const std::vector<CacheMatch>& matches, const std::shared_ptr<MetaDataCache>& cache, uint32_t MetaDataCacheBinFileNumber);
+
     static inline HDDCopyQueue* HDDCopyQueueInstance = nullptr;
     static inline SSDCopyQueue* SSDCopyQueueInstance = nullptr;
-};
\ No newline at end of file
+};
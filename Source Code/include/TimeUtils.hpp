@@ -1,3 +1,5 @@
+#pragma once
+
 #include <filesystem>
 #include <chrono>
 #include <ctime>
@@ -7,4 +9,12 @@ inline int64_t ToTimeT(std::filesystem::file_time_type FTime)
 {
     using namespace std::chrono;
     return duration_cast<nanoseconds>(FTime.time_since_epoch()).count();
-}
\ No newline at end of file
+}
+
+//Same representation as above, built from raw stat/statx seconds + nanoseconds so both scan paths produce identical values
+inline int64_t ToTimeT(int64_t Seconds, uint32_t Nanoseconds)
+{
+    using namespace std::chrono;
+    sys_time<nanoseconds> SysTime{ seconds{ Seconds } + nanoseconds{ Nanoseconds } };
+    return ToTimeT(time_point_cast<std::filesystem::file_time_type::duration>(file_clock::from_sys(SysTime)));
+}
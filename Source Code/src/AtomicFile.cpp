@@ -0,0 +1,219 @@
+#include "AtomicFile.hpp"
+#include "Logger.hpp"
+#include "Blake3/blake3.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+constexpr uint32_t CHECKSUM_TRAILER_MAGIC = 0x4B434344; // "DCCK"
+
+struct ChecksumTrailer
+{
+    std::array<uint8_t, 16> Checksum;
+    uint32_t Magic;
+};
+static_assert(sizeof(ChecksumTrailer) == 20, "ChecksumTrailer must not be padded");
+
+#ifdef _WIN32
+
+static bool WriteAndSync(const std::string& FilePath, const std::initializer_list<std::string_view>& Parts, const ChecksumTrailer* Trailer, bool AppendToFile)
+{
+    HANDLE File = CreateFileW(std::filesystem::path(FilePath).wstring().c_str(), AppendToFile ? FILE_APPEND_DATA : GENERIC_WRITE, 0, nullptr, AppendToFile ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    auto WriteAll = [File](const char* Data, size_t Size)
+    {
+        while (Size > 0)
+        {
+            DWORD Chunk = static_cast<DWORD>((std::min)(Size, static_cast<size_t>(1u << 30)));
+            DWORD Written = 0;
+            if (!WriteFile(File, Data, Chunk, &Written, nullptr))
+            {
+                return false;
+            }
+            Data += Written;
+            Size -= Written;
+        }
+        return true;
+    };
+
+    bool Ok = true;
+    for (std::string_view Part : Parts)
+    {
+        Ok = Ok && WriteAll(Part.data(), Part.size());
+    }
+    if (Trailer)
+    {
+        Ok = Ok && WriteAll(reinterpret_cast<const char*>(Trailer), sizeof(*Trailer));
+    }
+    Ok = Ok && FlushFileBuffers(File);
+    CloseHandle(File);
+    return Ok;
+}
+
+static bool RenameOver(const std::string& TempPath, const std::string& FilePath)
+{
+    return MoveFileExW(std::filesystem::path(TempPath).wstring().c_str(), std::filesystem::path(FilePath).wstring().c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+}
+
+#else
+
+static bool WriteAndSync(const std::string& FilePath, const std::initializer_list<std::string_view>& Parts, const ChecksumTrailer* Trailer, bool AppendToFile)
+{
+    int Fd = open(FilePath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (AppendToFile ? O_APPEND : O_TRUNC), 0644);
+    if (Fd < 0)
+    {
+        return false;
+    }
+
+    auto WriteAll = [Fd](const char* Data, size_t Size)
+    {
+        while (Size > 0)
+        {
+            ssize_t Written = write(Fd, Data, Size);
+            if (Written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            Data += Written;
+            Size -= static_cast<size_t>(Written);
+        }
+        return true;
+    };
+
+    bool Ok = true;
+    for (std::string_view Part : Parts)
+    {
+        Ok = Ok && WriteAll(Part.data(), Part.size());
+    }
+    if (Trailer)
+    {
+        Ok = Ok && WriteAll(reinterpret_cast<const char*>(Trailer), sizeof(*Trailer));
+    }
+    Ok = Ok && fsync(Fd) == 0;
+    Ok = close(Fd) == 0 && Ok;
+    return Ok;
+}
+
+static bool RenameOver(const std::string& TempPath, const std::string& FilePath)
+{
+    if (rename(TempPath.c_str(), FilePath.c_str()) != 0)
+    {
+        return false;
+    }
+
+    // Persist the rename itself, otherwise a power cut can bring back the old directory entry
+    std::string Dir = std::filesystem::path(FilePath).parent_path().string();
+    int DirFd = open(Dir.empty() ? "." : Dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (DirFd >= 0)
+    {
+        fsync(DirFd);
+        close(DirFd);
+    }
+    return true;
+}
+
+#endif
+
+bool AtomicFile::Write(const std::string& FilePath, std::initializer_list<std::string_view> Parts, bool AppendChecksum)
+{
+    ChecksumTrailer Trailer{};
+    if (AppendChecksum)
+    {
+        blake3_hasher Hasher;
+        blake3_hasher_init(&Hasher);
+        for (std::string_view Part : Parts)
+        {
+            blake3_hasher_update(&Hasher, Part.data(), Part.size());
+        }
+        blake3_hasher_finalize(&Hasher, Trailer.Checksum.data(), Trailer.Checksum.size());
+        Trailer.Magic = CHECKSUM_TRAILER_MAGIC;
+    }
+
+    std::string TempPath = FilePath + ".tmp";
+    if (!WriteAndSync(TempPath, Parts, AppendChecksum ? &Trailer : nullptr, false))
+    {
+        Log.Error(std::string("[AtomicFile] Failed to Write: ") + TempPath);
+        std::error_code ec;
+        std::filesystem::remove(TempPath, ec);
+        return false;
+    }
+    if (!RenameOver(TempPath, FilePath))
+    {
+        Log.Error(std::string("[AtomicFile] Failed to Replace: ") + FilePath);
+        std::error_code ec;
+        std::filesystem::remove(TempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+bool AtomicFile::Append(const std::string& FilePath, std::string_view Data)
+{
+    if (!WriteAndSync(FilePath, { Data }, nullptr, true))
+    {
+        Log.Error(std::string("[AtomicFile] Failed to Append: ") + FilePath);
+        return false;
+    }
+    return true;
+}
+
+CacheReadStatus AtomicFile::Read(const std::string& FilePath, std::string& Contents)
+{
+    Contents.clear();
+    std::ifstream File(FilePath, std::ios::binary);
+    if (!File)
+    {
+        return CacheReadStatus::Missing;
+    }
+    Contents.assign(std::istreambuf_iterator<char>(File), std::istreambuf_iterator<char>());
+    if (File.bad())
+    {
+        return CacheReadStatus::Corrupt;
+    }
+
+    ChecksumTrailer Trailer;
+    if (Contents.size() < sizeof(Trailer))
+    {
+        return CacheReadStatus::Loaded; // Written before checksum trailers
+    }
+    std::memcpy(&Trailer, Contents.data() + Contents.size() - sizeof(Trailer), sizeof(Trailer));
+    if (Trailer.Magic != CHECKSUM_TRAILER_MAGIC)
+    {
+        return CacheReadStatus::Loaded; // Written before checksum trailers
+    }
+
+    Contents.resize(Contents.size() - sizeof(Trailer));
+    std::array<uint8_t, 16> Checksum{};
+    blake3_hasher Hasher;
+    blake3_hasher_init(&Hasher);
+    blake3_hasher_update(&Hasher, Contents.data(), Contents.size());
+    blake3_hasher_finalize(&Hasher, Checksum.data(), Checksum.size());
+    if (Checksum != Trailer.Checksum)
+    {
+        Log.Error(std::string("[AtomicFile] Checksum Mismatch: ") + FilePath);
+        Contents.clear();
+        return CacheReadStatus::Corrupt;
+    }
+    return CacheReadStatus::Loaded;
+}
@@ -0,0 +1,120 @@
+#include "CacheStore.hpp"
+#include "ConfigGlobal.hpp"
+#include "CopyJournal.hpp"
+#include "SourceIndex.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+
+// Bins are read and written on the destination, a few streams keep it busy without turning the HDD case into seeks
+constexpr size_t CACHE_IO_THREADS = 4;
+
+std::mutex CacheStore::StoreMutex;
+std::condition_variable CacheStore::SavesDoneCV;
+std::unique_ptr<ThreadPool> CacheStore::IOPool;
+std::unordered_map<uint32_t, std::shared_future<std::shared_ptr<MetaDataCache>>> CacheStore::Prefetched;
+size_t CacheStore::PendingSaves = 0;
+
+ThreadPool& CacheStore::PoolLocked()
+{
+    if (!IOPool)
+    {
+        IOPool = std::make_unique<ThreadPool>(CACHE_IO_THREADS);
+    }
+    return *IOPool;
+}
+
+std::shared_ptr<MetaDataCache> CacheStore::LoadSource(uint32_t BinID)
+{
+    std::string cacheFilePath = (ConfigGlobal::DestinationCacheDir / (std::to_string(BinID) + ".bin")).string();
+
+    auto cache = std::make_shared<MetaDataCache>(cacheFilePath);
+    if (!cache->Load(BinID))
+    {
+        Log.Info(std::string("[CacheStore] Failed to Load Cache File: ") + cacheFilePath);
+    }
+    else
+    {
+        Log.Info(std::string("[CacheStore] Cache Loaded Successfully for BinID = ") + std::to_string(BinID));
+    }
+    // Files copied by an interrupted run count as up to date, only the rest is copied again
+    CopyJournal::Replay(BinID, *cache);
+    return cache;
+}
+
+void CacheStore::Prefetch(const std::vector<std::string>& Sources)
+{
+    std::lock_guard lock(StoreMutex);
+    for (const auto& source : Sources)
+    {
+        uint32_t id = SourceIndex::IDOf(source);
+        if (id == 0 || Prefetched.count(id))
+        {
+            continue;
+        }
+        auto load = std::make_shared<std::packaged_task<std::shared_ptr<MetaDataCache>()>>([id]() { return LoadSource(id); });
+        Prefetched[id] = load->get_future().share();
+        PoolLocked().Submit([load]() { (*load)(); });
+    }
+    Log.Info(std::string("[CacheStore] Prefetching ") + std::to_string(Prefetched.size()) + std::string(" Cache Bins"));
+}
+
+std::shared_ptr<MetaDataCache> CacheStore::Acquire(uint32_t BinID)
+{
+    std::shared_future<std::shared_ptr<MetaDataCache>> pending;
+    {
+        std::lock_guard lock(StoreMutex);
+        auto it = Prefetched.find(BinID);
+        if (it != Prefetched.end())
+        {
+            pending = std::move(it->second);
+            Prefetched.erase(it);
+        }
+    }
+    if (!pending.valid())
+    {
+        return LoadSource(BinID);
+    }
+    return pending.get();
+}
+
+void CacheStore::Save(std::shared_ptr<MetaDataCache> Cache, uint32_t BinID, std::function<void(bool)> Done)
+{
+    std::lock_guard lock(StoreMutex);
+    ++PendingSaves;
+    PoolLocked().Submit([Cache = std::move(Cache), BinID, Done = std::move(Done)]()
+    {
+        Cache->RemoveStaleEntries(ConfigGlobal::StaleEntries);
+        bool saved = Cache->Save(BinID);
+        if (!saved)
+        {
+            Log.Error(std::string("[CacheStore] Failed to Save Cache File Bin ID: ") + std::to_string(BinID));
+        }
+        if (Done)
+        {
+            Done(saved);
+        }
+        {
+            std::lock_guard doneLock(StoreMutex);
+            --PendingSaves;
+        }
+        SavesDoneCV.notify_all();
+    });
+}
+
+void CacheStore::WaitForSaves()
+{
+    std::unique_lock lock(StoreMutex);
+    SavesDoneCV.wait(lock, []() { return PendingSaves == 0; });
+}
+
+void CacheStore::Stop()
+{
+    std::unique_ptr<ThreadPool> pool;
+    {
+        std::lock_guard lock(StoreMutex);
+        Prefetched.clear();
+        pool = std::move(IOPool);
+    }
+    pool.reset(); // Runs what is still queued, then joins
+}
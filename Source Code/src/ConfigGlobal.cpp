@@ -10,10 +10,16 @@ namespace ConfigGlobal
     std::string Mode;
     std::string DiskType;
     std::string SSDMode;
+    std::string ChangeDetection;
+    std::string DiffMode;
     bool DeleteStaleFromDest;
     bool EnableCacheRestoreFromBackup;
     bool EnableBackupCopyAfterRun;
     bool DestinationTopFolderInsteadOfFullPath;
+    bool IOUringScan;
+    bool DirectorySkipIndex;
+    bool ReflinkCopy;
+    bool DropPageCache;
     
     unsigned short int MaxLogFiles;
     unsigned short int ThreadCount;
@@ -21,6 +27,8 @@ namespace ConfigGlobal
     unsigned short int GodSpeedParallelFilesPerSourcesCount;
     unsigned short int ParallelFilesPerSourceCount;
     unsigned short int StaleEntries;
+    unsigned short int ParallelScanThreadCount;
+    unsigned short int IOUringQueueDepth;
 
     std::filesystem::path DestinationCacheDir;
     std::filesystem::path DestinationIndexFileName;
@@ -48,5 +56,13 @@ namespace ConfigGlobal
         EnableBackupCopyAfterRun = true;
         DestinationTopFolderInsteadOfFullPath = false;
         MaxLogFiles = 10;
+        ParallelScanThreadCount = 1; //1 = Single threaded walk per source
+        IOUringScan = false; //Linux only
+        IOUringQueueDepth = 64;
+        DirectorySkipIndex = false; //Linux only
+        ChangeDetection = "Metadata";
+        DiffMode = "Lookup";
+        ReflinkCopy = true; //Linux only
+        DropPageCache = true; //Linux only
     }
 }
\ No newline at end of file
@@ -12,6 +12,7 @@
 #include "FileCopier.hpp"
 #include "ConfigGlobal.hpp"
 #include "FailureDetect.hpp"
+#include "ExcludeMatcher.hpp"
 
 namespace FS = std::filesystem;
 
@@ -247,9 +248,9 @@ bool ConfigParser::Parse(const std::string& FilePath)
 
         else if (Key == "Exclude")
         {
-            if (!IsAbsolutePath(Value))
+            if (!IsAbsolutePath(Value) && !ExcludeMatcher::IsNamePattern(Value))
             {
-                AddError("Line " + std::to_string(LineNumber) + ": Exclude path is not absolute.");
+                AddError("Line " + std::to_string(LineNumber) + ": Exclude path is not absolute and not a name pattern.");
                 continue;
             }
             if (std::find(Excludes.begin(), Excludes.end(), Value) != Excludes.end())
@@ -366,6 +367,157 @@ bool ConfigParser::Parse(const std::string& FilePath)
             }
         }
 
+        else if (Key == "ParallelScanThreadCount")
+        {
+            try
+            {
+                unsigned short int ValueNum = std::stoi(Value);
+                if (ValueNum == 0)
+                {
+                    AddError("Line " + std::to_string(LineNumber) + ": ParallelScanThreadCount must be greater than zero.");
+                    continue;
+                }
+                ConfigGlobal::ParallelScanThreadCount = ValueNum;
+                AddInfo("ParallelScanThreadCount set to " + std::to_string(ValueNum));
+            }
+            catch (...)
+            {
+                AddError("Line " + std::to_string(LineNumber) + ": Invalid number for ParallelScanThreadCount.");
+            }
+        }
+
+        else if (Key == "IOUringScan")
+        {
+            if (Value == "YES")
+            {
+                ConfigGlobal::IOUringScan = true;
+                AddInfo("Enabled io_uring Batched Scanning (Linux only, falls back to synchronous scanning if unavailable)");
+            }
+            else if (Value == "NO")
+            {
+                ConfigGlobal::IOUringScan = false;
+                AddInfo("Disabled io_uring Batched Scanning");
+            }
+            else
+            {
+                AddError("Line " + std::to_string(LineNumber) + ": Invalid Input. Use 'YES' or 'NO'.");
+            }
+        }
+
+        else if (Key == "ReflinkCopy")
+        {
+            if (Value == "YES")
+            {
+                ConfigGlobal::ReflinkCopy = true;
+                AddInfo("Enabled Reflink Copies (Linux only, files are cloned when source and destination share a filesystem that supports it)");
+            }
+            else if (Value == "NO")
+            {
+                ConfigGlobal::ReflinkCopy = false;
+                AddInfo("Disabled Reflink Copies, every file is copied in full");
+            }
+            else
+            {
+                AddError("Line " + std::to_string(LineNumber) + ": Invalid Input. Use 'YES' or 'NO'.");
+            }
+        }
+
+        else if (Key == "DropPageCache")
+        {
+            if (Value == "YES")
+            {
+                ConfigGlobal::DropPageCache = true;
+                AddInfo("Enabled Dropping Copied Files from Page Cache (Linux only)");
+            }
+            else if (Value == "NO")
+            {
+                ConfigGlobal::DropPageCache = false;
+                AddInfo("Disabled Dropping Copied Files from Page Cache");
+            }
+            else
+            {
+                AddError("Line " + std::to_string(LineNumber) + ": Invalid Input. Use 'YES' or 'NO'.");
+            }
+        }
+
+        else if (Key == "DirectorySkipIndex")
+        {
+            if (Value == "YES")
+            {
+                ConfigGlobal::DirectorySkipIndex = true;
+                AddInfo("Enabled Directory Skip Index, Unchanged Directories will not be Re-Listed (Linux only)");
+            }
+            else if (Value == "NO")
+            {
+                ConfigGlobal::DirectorySkipIndex = false;
+                AddInfo("Disabled Directory Skip Index");
+            }
+            else
+            {
+                AddError("Line " + std::to_string(LineNumber) + ": Invalid Input. Use 'YES' or 'NO'.");
+            }
+        }
+
+        else if (Key == "IOUringQueueDepth")
+        {
+            try
+            {
+                unsigned short int ValueNum = std::stoi(Value);
+                if (ValueNum == 0 || ValueNum > 4096)
+                {
+                    AddError("Line " + std::to_string(LineNumber) + ": IOUringQueueDepth must be between 1 and 4096.");
+                    continue;
+                }
+                ConfigGlobal::IOUringQueueDepth = ValueNum;
+                AddInfo("IOUringQueueDepth set to " + std::to_string(ValueNum));
+            }
+            catch (...)
+            {
+                AddError("Line " + std::to_string(LineNumber) + ": Invalid number for IOUringQueueDepth.");
+            }
+        }
+
+        else if (Key == "ChangeDetection")
+        {
+            if (Value == "Metadata")
+            {
+                ConfigGlobal::ChangeDetection = "Metadata";
+                AddInfo("ChangeDetection set to 'Metadata' (Path, Size and Modification Time).");
+            }
+            else if (Value == "Content")
+            {
+                ConfigGlobal::ChangeDetection = "Content";
+                AddInfo("ChangeDetection set to 'Content' (Full File Contents are Hashed).");
+            }
+            else if (Value == "Hybrid")
+            {
+                ConfigGlobal::ChangeDetection = "Hybrid";
+                AddInfo("ChangeDetection set to 'Hybrid' (Contents Hashed only when Metadata is Ambiguous).");
+            }
+            else
+            {
+                AddError("Line " + std::to_string(LineNumber) + ": Invalid ChangeDetection. Use 'Metadata', 'Content' or 'Hybrid'.");
+            }
+        }
+
+        else if (Key == "DiffMode")
+        {
+            if (Value == "Lookup")
+            {
+                ConfigGlobal::DiffMode = "Lookup";
+                AddInfo("DiffMode set to 'Lookup' (Each Batch Diffed as it is Scanned).");
+            }
+            else if (Value == "MergeJoin")
+            {
+                ConfigGlobal::DiffMode = "MergeJoin";
+                AddInfo("DiffMode set to 'MergeJoin' (Sorted Scan Merged with the Cache in One Pass).");
+            }
+            else
+            {
+                AddError("Line " + std::to_string(LineNumber) + ": Invalid DiffMode. Use 'Lookup' or 'MergeJoin'.");
+            }
+        }
+
         else if (Key == "DiskType")
         {
             if (Value == "SSD")
@@ -9,11 +9,40 @@
 #include "ThreadPool.hpp"
 #include "SyncEngine.hpp"
 #include "FailureDetect.hpp"
+#include "SourceIndex.hpp"
+#include "CopyState.hpp"
+#include "CacheStore.hpp"
+#include "FileCopier.hpp"
 
 #ifdef _WIN32
 #include <windows.h>
+#include <psapi.h>
 #endif
 
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+// Peak resident set size of the process so far in MB, 0 if the platform doesn't report it
+static uint64_t PeakRSSMegabytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return static_cast<uint64_t>(counters.PeakWorkingSetSize) / (1024 * 1024);
+    }
+#endif
+#ifdef __linux__
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        return static_cast<uint64_t>(usage.ru_maxrss) / 1024; // ru_maxrss is in KB
+    }
+#endif
+    return 0;
+}
+
 int ControlFlow::Run()
 {
     Log.Init(ConfigGlobal::LogDir);
@@ -86,47 +115,31 @@ int ControlFlow::Run()
         Log.Info(Info);
     }
 
-    Log.Info("Scanning Source Directories...");
-    std::cout << "Scanning Source Directories...\n";
+    // Sources are streamed scan -> hash -> diff -> copy, the copy queues are running before the first directory is read
+    CopyState::ResetAll();
+    SourceIndex::Build(Parser.GetSources());
+    CacheStore::Prefetch(Parser.GetSources()); // Bins load in the background while the first sources scan
 
-    ThreadPool Pool(ConfigGlobal::ThreadCount);
-    std::unordered_map<std::string, std::vector<ScannedFileInfo>> PerSourceResults;
-    std::mutex ResultMutex;
-
-    for (const auto& Source : Parser.GetSources())
-    {
-        Pool.Submit([Source, &PerSourceResults, &ResultMutex, this]()
-        {
-            std::cout << "Scanning: " << Source << std::endl;
-            FileScanner LocalScanner;
-            LocalScanner.SetExcludes(Parser.GetExcludes());
-            LocalScanner.Scan(Source);
-            std::lock_guard<std::mutex> Lock(ResultMutex);
-            PerSourceResults[Source] = std::move(LocalScanner.GetFiles());
-        });
-    }
-    Pool.Join();
+    Log.Info("Scanning Source Directories and Initiating Copying...");
+    std::cout << "Scanning Source Directories and Initiating Copying...\n";
 
-    Log.Info("Scanning Sources Complete");
-    std::cout << "Scanning Source Complete\n";
-
-    LogScannedFiles();
-    Meta.ResetCopiedFlags();
-    
-    Log.Info("Initiating Copying...");
-    std::cout << "Initiating Copying...\n";
+    ThreadPool Pool(ConfigGlobal::ThreadCount);
 
     if (ConfigGlobal::DiskType == "HDD")
     {
         HDDCopy.Start();
         SyncEngine::SetHDDCopyQueue(&HDDCopy); // Let SyncEngine access the copy system
 
-        for (const auto& [Source, Files] : PerSourceResults)
+        for (const auto& Source : Parser.GetSources())
         {
             HDDCopy.IncrementPendingSources();
-            Pool.Submit([Source, Files, this]() {Meta.UpdateCacheForSource(Source, Files);});
+            Pool.Submit([Source, this]() {Meta.ScanAndSyncSource(Source, Parser.GetExcludes()); });
         }
         Pool.Join();
+        Log.Info("Scanning Sources Complete");
+        std::cout << "Scanning Source Complete\n";
+        LogScannedFiles();
+
         HDDCopy.MarkAllSourcesSubmitted();
         HDDCopy.WaitUntilDone();
         HDDCopy.Stop();
@@ -137,20 +150,33 @@ int ControlFlow::Run()
         SSDCopy.Start();
         SyncEngine::SetSSDCopyQueue(&SSDCopy); // Let SyncEngine access the copy system
 
-        for (const auto& [Source, Files] : PerSourceResults)
+        for (const auto& Source : Parser.GetSources())
         {
             SSDCopy.IncrementPendingSources();
-            Pool.Submit([Source, Files, this]() {Meta.UpdateCacheForSource(Source, Files); });
+            Pool.Submit([Source, this]() {Meta.ScanAndSyncSource(Source, Parser.GetExcludes()); });
         }
         Pool.Join();
+        Log.Info("Scanning Sources Complete");
+        std::cout << "Scanning Source Complete\n";
+        LogScannedFiles();
+
         SSDCopy.MarkAllSourcesSubmitted();
         SSDCopy.WaitUntilDone();
         SSDCopy.Stop();
     }
 
+    // Cache bins of the last sources may still be writing
+    CacheStore::WaitForSaves();
+    CacheStore::Stop();
+
     Log.Info("Copying Procedure Completed");
     std::cout << "Copying Procedure Completed\n";
+#ifndef _WIN32
+    FileCopier::LogCopyStats();
+#endif
+    Log.Info(std::string("[ControlFlow] Peak RSS: ") + std::to_string(PeakRSSMegabytes()) + std::string(" MB"));
 
+    CopyState::Flush();
     FailureDetect::MarkSuccess();
 
     if (ConfigGlobal::EnableBackupCopyAfterRun)
@@ -225,17 +251,18 @@ void ControlFlow::LogScannedFiles()
 
     for (const auto& Entry : ScannedFiles)
     {
+        std::string Path = Scanner.GetPaths().Join(Entry.DirID, Entry.Name);
         bool IsExcluded = false;
         for (const auto& Exclude : Parser.GetExcludes())
         {
-            if (Entry.RelativePath.find(Exclude) != std::string::npos)
+            if (Path.find(Exclude) != std::string::npos)
             {
                 IsExcluded = true;
                 break;
             }
         }
 
-        std::string LogLine = Entry.RelativePath + " | " + std::to_string(Entry.Size) + " bytes | mtime: " + std::to_string(Entry.MTime);
+        std::string LogLine = Path + " | " + std::to_string(Entry.Size) + " bytes | mtime: " + std::to_string(Entry.MTime);
         if (IsExcluded)
         {
             LogLine += " [EXCLUDED]";
@@ -0,0 +1,170 @@
+#include "CopyJournal.hpp"
+#include "AtomicFile.hpp"
+#include "ConfigGlobal.hpp"
+#include "Blake3/blake3.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+
+constexpr size_t JOURNAL_SYNC_RECORDS = 256;
+constexpr std::chrono::milliseconds JOURNAL_SYNC_INTERVAL(1000);
+
+// Record: uint32 payload size, payload, uint32 checksum(first 4 bytes of the payload's BLAKE3)
+// Payload: Size, MTime, CTime, Inode, Hash[16], ContentHashed, path bytes
+constexpr size_t JOURNAL_FIXED_PAYLOAD = 4 * sizeof(uint64_t) + 16 + 1;
+
+static uint32_t RecordChecksum(const char* Payload, size_t Size)
+{
+    uint32_t Checksum = 0;
+    blake3_hasher Hasher;
+    blake3_hasher_init(&Hasher);
+    blake3_hasher_update(&Hasher, Payload, Size);
+    blake3_hasher_finalize(&Hasher, reinterpret_cast<uint8_t*>(&Checksum), sizeof(Checksum));
+    return Checksum;
+}
+
+template<typename T>
+static void AppendValue(std::string& Out, const T& Value)
+{
+    Out.append(reinterpret_cast<const char*>(&Value), sizeof(T));
+}
+
+template<typename T>
+static void ReadValue(const char*& Cursor, T& Value)
+{
+    std::memcpy(&Value, Cursor, sizeof(T));
+    Cursor += sizeof(T);
+}
+
+CopyJournal::~CopyJournal()
+{
+    Flush();
+}
+
+std::string CopyJournal::JournalPath(uint32_t BinID)
+{
+    return (ConfigGlobal::DestinationCacheDir / (std::to_string(BinID) + ".journal")).string();
+}
+
+void CopyJournal::Record(uint32_t BinID, const FileInfo& File)
+{
+    std::lock_guard lock(JournalMutex);
+    std::string& Buffer = Pending[BinID];
+
+    uint32_t PayloadSize = static_cast<uint32_t>(JOURNAL_FIXED_PAYLOAD + File.AbsolutePath.size());
+    AppendValue(Buffer, PayloadSize);
+    size_t PayloadStart = Buffer.size();
+    AppendValue(Buffer, File.Size);
+    AppendValue(Buffer, File.MTime);
+    AppendValue(Buffer, File.CTime);
+    AppendValue(Buffer, File.Inode);
+    Buffer.append(reinterpret_cast<const char*>(File.Hash.data()), File.Hash.size());
+    AppendValue(Buffer, static_cast<uint8_t>(File.ContentHashed));
+    Buffer.append(File.AbsolutePath);
+    AppendValue(Buffer, RecordChecksum(Buffer.data() + PayloadStart, PayloadSize));
+
+    if (++PendingRecords >= JOURNAL_SYNC_RECORDS || std::chrono::steady_clock::now() - LastSync >= JOURNAL_SYNC_INTERVAL)
+    {
+        FlushLocked();
+    }
+}
+
+void CopyJournal::Flush()
+{
+    std::lock_guard lock(JournalMutex);
+    FlushLocked();
+}
+
+void CopyJournal::FlushLocked()
+{
+    for (auto& [BinID, Buffer] : Pending)
+    {
+        if (!Buffer.empty() && !AtomicFile::Append(JournalPath(BinID), Buffer))
+        {
+            Log.Error(std::string("[CopyJournal] Failed to Append Journal for BinID = ") + std::to_string(BinID) + std::string(", these files will be copied again on the next run"));
+        }
+        Buffer.clear();
+    }
+    PendingRecords = 0;
+    LastSync = std::chrono::steady_clock::now();
+}
+
+void CopyJournal::Discard(uint32_t BinID)
+{
+    std::lock_guard lock(JournalMutex);
+    Pending.erase(BinID);
+    Remove(BinID);
+}
+
+void CopyJournal::Remove(uint32_t BinID)
+{
+    std::error_code ec;
+    std::filesystem::remove(JournalPath(BinID), ec);
+}
+
+size_t CopyJournal::Replay(uint32_t BinID, MetaDataCache& Cache)
+{
+    std::ifstream File(JournalPath(BinID), std::ios::binary);
+    if (!File)
+    {
+        return 0; // No journal, the last run for this source finished cleanly
+    }
+    std::string Contents((std::istreambuf_iterator<char>(File)), std::istreambuf_iterator<char>());
+    File.close();
+
+    size_t Applied = 0;
+    size_t ValidBytes = 0;
+    const char* Cursor = Contents.data();
+    const char* End = Contents.data() + Contents.size();
+    while (static_cast<size_t>(End - Cursor) >= sizeof(uint32_t))
+    {
+        uint32_t PayloadSize = 0;
+        ReadValue(Cursor, PayloadSize);
+        if (PayloadSize < JOURNAL_FIXED_PAYLOAD || static_cast<size_t>(End - Cursor) < PayloadSize + sizeof(uint32_t))
+        {
+            break; // Torn tail of a batch that was being appended when the run died
+        }
+        const char* Payload = Cursor;
+        uint32_t Checksum = 0;
+        std::memcpy(&Checksum, Payload + PayloadSize, sizeof(Checksum));
+        if (Checksum != RecordChecksum(Payload, PayloadSize))
+        {
+            Log.Error(std::string("[CopyJournal] Corrupt Journal Record, Ignoring the Rest of BinID = ") + std::to_string(BinID));
+            break;
+        }
+
+        FileInfo Info;
+        uint8_t ContentHashed = 0;
+        ReadValue(Cursor, Info.Size);
+        ReadValue(Cursor, Info.MTime);
+        ReadValue(Cursor, Info.CTime);
+        ReadValue(Cursor, Info.Inode);
+        std::memcpy(Info.Hash.data(), Cursor, Info.Hash.size());
+        Cursor += Info.Hash.size();
+        ReadValue(Cursor, ContentHashed);
+        Info.ContentHashed = ContentHashed != 0;
+        Info.AbsolutePath.assign(Cursor, PayloadSize - JOURNAL_FIXED_PAYLOAD);
+        Cursor = Payload + PayloadSize + sizeof(uint32_t);
+
+        Cache.UpdateEntry(std::move(Info));
+        ++Applied;
+        ValidBytes = static_cast<size_t>(Cursor - Contents.data());
+    }
+
+    if (ValidBytes < Contents.size())
+    {
+        // Records appended by this run have to follow the last intact one, behind a torn tail the next replay would never reach them
+        std::error_code ec;
+        std::filesystem::resize_file(JournalPath(BinID), ValidBytes, ec);
+        if (ec)
+        {
+            Log.Error(std::string("[CopyJournal] Failed to Truncate Torn Journal, Removing it for BinID = ") + std::to_string(BinID) + std::string(": ") + ec.message());
+            Remove(BinID);
+        }
+    }
+
+    Log.Info(std::string("[CopyJournal] Replayed ") + std::to_string(Applied) + std::string(" Copied Files for BinID = ") + std::to_string(BinID));
+    return Applied;
+}
@@ -0,0 +1,125 @@
+#include "CopyState.hpp"
+#include "AtomicFile.hpp"
+#include "ConfigGlobal.hpp"
+#include "Logger.hpp"
+
+#include <sstream>
+
+constexpr std::chrono::milliseconds COPY_STATE_FLUSH_INTERVAL(2000);
+
+std::mutex CopyState::StateMutex;
+std::unordered_map<uint32_t, bool> CopyState::IDCopiedFlag;
+bool CopyState::Dirty = false;
+std::chrono::steady_clock::time_point CopyState::LastWrite;
+
+// Load copy status flags for BinIDs
+bool CopyState::Load()
+{
+    std::lock_guard lock(StateMutex);
+    return LoadLocked();
+}
+
+bool CopyState::LoadLocked()
+{
+    IDCopiedFlag.clear();
+    Dirty = false;
+
+    std::string contents;
+    CacheReadStatus status = AtomicFile::Read(ConfigGlobal::StateIndexFileName.string(), contents);
+    if (status == CacheReadStatus::Missing)
+    {
+        // No file yet is not an error(first run)
+        return true;
+    }
+    if (status == CacheReadStatus::Corrupt)
+    {
+        return false;
+    }
+    std::istringstream file(contents);
+
+    uint32_t count = 0;
+    file.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!file)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t id = 0;
+        bool copied = false;
+
+        file.read(reinterpret_cast<char*>(&id), sizeof(id));
+        file.read(reinterpret_cast<char*>(&copied), sizeof(copied));
+
+        if (!file)
+        {
+            return false;
+        }
+
+        IDCopiedFlag[id] = copied;
+    }
+    Log.Info(std::string("[CopyState] Loaded ") + std::to_string(IDCopiedFlag.size()) + std::string(" entries."));
+    return true;
+}
+
+// Save copy status flags for BinIDs
+bool CopyState::WriteLocked()
+{
+    std::ostringstream file;
+
+    uint32_t count = static_cast<uint32_t>(IDCopiedFlag.size());
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+    for (const auto& [id, copied] : IDCopiedFlag)
+    {
+        file.write(reinterpret_cast<const char*>(&id), sizeof(id));
+        file.write(reinterpret_cast<const char*>(&copied), sizeof(copied));
+    }
+    LastWrite = std::chrono::steady_clock::now();
+    if (!file || !AtomicFile::Write(ConfigGlobal::StateIndexFileName.string(), { file.view() }))
+    {
+        Log.Error(std::string("[CopyState] Failed to Save Copy State"));
+        return false;
+    }
+    Dirty = false;
+    Log.Info(std::string("[CopyState] Saved ") + std::to_string(IDCopiedFlag.size()) + std::string(" entries."));
+    return true;
+}
+
+bool CopyState::ResetAll()
+{
+    std::lock_guard lock(StateMutex);
+    LoadLocked();
+    for (auto& entry : IDCopiedFlag)
+    {
+        entry.second = false;
+    }
+    Log.Info(std::string("[CopyState] Copy Flags Reset"));
+    return WriteLocked();
+}
+
+void CopyState::MarkCopied(uint32_t BinID)
+{
+    std::lock_guard lock(StateMutex);
+    IDCopiedFlag[BinID] = true;
+    Dirty = true;
+    Log.Info(std::string("[CopyState] Copy Flag Set to True for BinID = ") + std::to_string(BinID));
+    if (std::chrono::steady_clock::now() - LastWrite >= COPY_STATE_FLUSH_INTERVAL)
+    {
+        WriteLocked();
+    }
+}
+
+bool CopyState::IsCopied(uint32_t BinID)
+{
+    std::lock_guard lock(StateMutex);
+    auto it = IDCopiedFlag.find(BinID);
+    return it != IDCopiedFlag.end() && it->second;
+}
+
+bool CopyState::Flush()
+{
+    std::lock_guard lock(StateMutex);
+    return !Dirty || WriteLocked();
+}
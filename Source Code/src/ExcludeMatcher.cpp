@@ -0,0 +1,247 @@
+#include "ExcludeMatcher.hpp"
+
+namespace
+{
+#ifdef _WIN32
+    inline bool IsSeparator(char c) { return c == '\\' || c == '/'; }
+#else
+    inline bool IsSeparator(char c) { return c == '/'; }
+#endif
+
+    // \\?\C:\x and \\?\UNC\server\share are matched like C:\x and \\server\share
+    std::string_view StripLongPathPrefix(std::string_view Path)
+    {
+#ifdef _WIN32
+        if (Path.starts_with("\\\\?\\UNC\\"))
+        {
+            return Path.substr(8);
+        }
+        if (Path.starts_with("\\\\?\\"))
+        {
+            return Path.substr(4);
+        }
+#endif
+        return Path;
+    }
+
+    // Walks the non empty components of a path, no allocation
+    template<typename Func>
+    bool ForEachComponent(std::string_view Path, Func&& Visit)
+    {
+        size_t Pos = 0;
+        while (Pos < Path.size())
+        {
+            while (Pos < Path.size() && IsSeparator(Path[Pos]))
+            {
+                ++Pos;
+            }
+            size_t End = Pos;
+            while (End < Path.size() && !IsSeparator(Path[End]))
+            {
+                ++End;
+            }
+            if (End > Pos && !Visit(Path.substr(Pos, End - Pos)))
+            {
+                return false;
+            }
+            Pos = End;
+        }
+        return true;
+    }
+}
+
+bool ExcludeMatcher::IsNamePattern(std::string_view Exclude)
+{
+    while (!Exclude.empty() && IsSeparator(Exclude.back()))
+    {
+        Exclude.remove_suffix(1);
+    }
+    if (Exclude.empty())
+    {
+        return false;
+    }
+    for (char c : Exclude)
+    {
+        if (IsSeparator(c))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ExcludeMatcher::Compile(const std::vector<std::string>& Excludes)
+{
+    Trie.assign(1, TrieNode{});
+    AnyPatterns = NamePatterns{};
+    DirectoryPatterns = NamePatterns{};
+
+    for (const auto& Exclude : Excludes)
+    {
+        if (IsNamePattern(Exclude))
+        {
+            AddNamePattern(Exclude);
+        }
+        else
+        {
+            AddPath(Exclude);
+        }
+    }
+}
+
+bool ExcludeMatcher::Empty() const
+{
+    return Trie.size() <= 1 && AnyPatterns.Empty() && DirectoryPatterns.Empty();
+}
+
+void ExcludeMatcher::AddPath(std::string_view Path)
+{
+    size_t Node = 0;
+    ForEachComponent(StripLongPathPrefix(Path), [this, &Node](std::string_view Component)
+    {
+        auto It = Trie[Node].Children.find(Component);
+        if (It == Trie[Node].Children.end())
+        {
+            size_t Next = Trie.size();
+            Trie[Node].Children.emplace(std::string(Component), Next);
+            Trie.emplace_back();
+            Node = Next;
+        }
+        else
+        {
+            Node = It->second;
+        }
+        return true;
+    });
+    if (Node != 0)
+    {
+        Trie[Node].Terminal = true;
+    }
+}
+
+void ExcludeMatcher::AddNamePattern(std::string_view Pattern)
+{
+    NamePatterns* Target = &AnyPatterns;
+    if (IsSeparator(Pattern.back()))
+    {
+        Target = &DirectoryPatterns;
+        while (IsSeparator(Pattern.back()))
+        {
+            Pattern.remove_suffix(1);
+        }
+    }
+
+    if (Pattern.find_first_of("*?") == std::string_view::npos)
+    {
+        Target->Names.emplace(Pattern);
+    }
+    else if (Pattern.starts_with("*.") && Pattern.find_first_of("*?.", 2) == std::string_view::npos)
+    {
+        Target->Extensions.emplace(Pattern.substr(2));
+    }
+    else
+    {
+        Target->Globs.emplace_back(Pattern);
+    }
+}
+
+bool ExcludeMatcher::Matches(std::string_view Path, bool IsDirectory) const
+{
+    if (Trie.size() > 1 && MatchesTrie(Path))
+    {
+        return true;
+    }
+    if (AnyPatterns.Empty() && (!IsDirectory || DirectoryPatterns.Empty()))
+    {
+        return false;
+    }
+
+    while (!Path.empty() && IsSeparator(Path.back()))
+    {
+        Path.remove_suffix(1);
+    }
+    size_t Pos = Path.size();
+    while (Pos > 0 && !IsSeparator(Path[Pos - 1]))
+    {
+        --Pos;
+    }
+    std::string_view Name = Path.substr(Pos);
+
+    return AnyPatterns.Matches(Name) || (IsDirectory && DirectoryPatterns.Matches(Name));
+}
+
+bool ExcludeMatcher::MatchesTrie(std::string_view Path) const
+{
+    size_t Node = 0;
+    bool Excluded = false;
+    ForEachComponent(StripLongPathPrefix(Path), [this, &Node, &Excluded](std::string_view Component)
+    {
+        auto It = Trie[Node].Children.find(Component);
+        if (It == Trie[Node].Children.end())
+        {
+            return false;
+        }
+        Node = It->second;
+        Excluded = Trie[Node].Terminal;
+        return !Excluded;
+    });
+    return Excluded;
+}
+
+bool ExcludeMatcher::NamePatterns::Matches(std::string_view Name) const
+{
+    if (!Names.empty() && Names.find(Name) != Names.end())
+    {
+        return true;
+    }
+    if (!Extensions.empty())
+    {
+        size_t Dot = Name.rfind('.');
+        if (Dot != std::string_view::npos && Extensions.find(Name.substr(Dot + 1)) != Extensions.end())
+        {
+            return true;
+        }
+    }
+    for (const auto& Glob : Globs)
+    {
+        if (GlobMatch(Glob, Name))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Iterative wildcard match, * backtracks to the last star only so the worst case stays O(pattern * name)
+bool ExcludeMatcher::GlobMatch(std::string_view Pattern, std::string_view Name)
+{
+    size_t p = 0, n = 0;
+    size_t StarP = std::string_view::npos, StarN = 0;
+    while (n < Name.size())
+    {
+        if (p < Pattern.size() && (Pattern[p] == '?' || Pattern[p] == Name[n]))
+        {
+            ++p;
+            ++n;
+        }
+        else if (p < Pattern.size() && Pattern[p] == '*')
+        {
+            StarP = p++;
+            StarN = n;
+        }
+        else if (StarP != std::string_view::npos)
+        {
+            p = StarP + 1;
+            n = ++StarN;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (p < Pattern.size() && Pattern[p] == '*')
+    {
+        ++p;
+    }
+    return p == Pattern.size();
+}
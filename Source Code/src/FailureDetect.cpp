@@ -5,6 +5,11 @@
 #include "FileHasher.hpp"
 #include "ConfigGlobal.hpp"
 #include "FileScanner.hpp"
+#include "SyncEngine.hpp"
+#include "CopyJournal.hpp"
+#include "SourceIndex.hpp"
+#include "CopyState.hpp"
+#include "TimeUtils.hpp"
 #include "Logger.hpp"
 
 #include <iostream>
@@ -152,7 +157,6 @@ namespace FailureDetect
     {
         FileScanner Scanner;
         ConfigParser Parser;
-        MetaDataCache Meta;
         FileHasher Hash;
         FileCopier Copier;
         
@@ -178,14 +182,9 @@ namespace FailureDetect
         Log.Info("Config Parsed Successfully.");
         std::cout << "Config Parsed Successfully.\n";
 
-        std::unordered_map<std::string, uint32_t> PathToID;
-        std::unordered_map<uint32_t, std::string> IDToPath;
-
-        Meta.LoadIndex(PathToID, IDToPath);
+        SourceIndex::Load();
         
-        std::string stateFilePath = (std::filesystem::path(ConfigGlobal::DestinationCacheDir) / "State.bin").string();
-        MetaDataCache FailCopyStateCache(stateFilePath);
-        if (!FailCopyStateCache.LoadCopiedState())
+        if (!CopyState::Load())
         {
             std::cerr << "Failed to Load Copy State File.\n";
             Log.Error(std::string("[Recovery] Failed to load copy state file"));
@@ -195,17 +194,16 @@ namespace FailureDetect
         std::vector<std::pair<std::string, uint32_t>> FailPendingSources;
         for (const auto& sourcePath : Parser.GetSources())
         {
-            auto it = PathToID.find(sourcePath);
-            if (it == PathToID.end())
+            uint32_t sourceId = SourceIndex::IDOf(sourcePath);
+            if (sourceId == 0)
             {
                 std::cerr << "Source not found in index: " << sourcePath << "\n";
                 Log.Info(std::string("[Recovery] Source not found in index: ") + sourcePath);
                 Log.Info(std::string("Check if source was present in previous run, if new source added, then no issue(source won't be copied now, so run again for new source addition), if not then delete all caches from folder because cache is corrupt "));
                 continue;
             }
-            uint32_t sourceId = it->second;
 
-            if (FailCopyStateCache.GetCopiedMap().find(sourceId) == FailCopyStateCache.GetCopiedMap().end() || !FailCopyStateCache.IsCopied(sourceId))
+            if (!CopyState::IsCopied(sourceId))
             {
                 FailPendingSources.emplace_back(sourcePath, sourceId);
                 std::cout << "Pending Source : " << sourcePath << "\n";
@@ -232,9 +230,16 @@ namespace FailureDetect
                 overallSuccess = false;
                 continue;
             }
+            // Resume from the last file the failed run recorded as copied
+            size_t journaled = CopyJournal::Replay(sourceId, FailSourceCache);
+            if (journaled > 0)
+            {
+                std::cout << "Resuming after " << journaled << " files already copied\n";
+            }
 
             std::cout << "Scanning: " << sourcePath << std::endl;
             Scanner.SetExcludes(Parser.GetExcludes());
+            Scanner.Clear(); // Previous source's files and paths
             Scanner.Scan(sourcePath);
             const auto& scannedFiles = Scanner.GetFiles();
 
@@ -242,52 +247,82 @@ namespace FailureDetect
             for (const auto& scanned : scannedFiles)
             {
                 FileInfo info;
-                info.AbsolutePath = scanned.RelativePath;
+                info.AbsolutePath = Scanner.GetPaths().Join(scanned.DirID, scanned.Name);
                 info.Size = scanned.Size;
                 info.MTime = scanned.MTime;
+                info.CTime = scanned.CTime;
+                info.Inode = scanned.Inode;
                 freshFiles.push_back(std::move(info));
             }
 
-            Hash.HashFiles(freshFiles);
+            std::vector<CacheMatch> matches;
+            if (ConfigGlobal::ChangeDetection == "Hybrid")
+            {
+                matches = SyncEngine::ResolveHybridHashes(freshFiles, FailSourceCache, FailSourceCache.GetLastScanTime(), ToTimeT(std::filesystem::file_time_type::clock::now()), Hash);
+            }
+            else
+            {
+                Hash.HashFiles(freshFiles);
+                matches = SyncEngine::ClassifyBatch(freshFiles, FailSourceCache);
+            }
             Log.Info(std::string("Completed Hashing for Source: ") + sourcePath);
             std::queue<FileInfo> FailCopyQueue;
 
-            for (const auto& file : freshFiles)
+            for (size_t i = 0; i < freshFiles.size(); ++i)
             {
+                FileInfo& file = freshFiles[i];
                 const std::string& absPath = file.AbsolutePath;
 
-                bool isNew = !FailSourceCache.HasEntry(absPath);
-                bool isChanged = false;
-
-                if (!isNew)
-                {
-                    FileInfo cached = FailSourceCache.GetEntry(absPath);
-                    if (cached.Hash != file.Hash)
-                    {
-                        isChanged = true;
-                    }
-                }
-                if (isNew || isChanged)
+                if (matches[i] != CacheMatch::Unchanged)
                 {
                     Log.Info(std::string("[Sync Engine] Added to HDDCopyQueue: ") + absPath);
-                    FailCopyQueue.emplace(file);
+                    FailCopyQueue.push(std::move(file));
                 }
                 else
                 {
                     Log.Info(std::string("[Sync Engine] File Skipped: ") + absPath);
                 }
             }
+            freshFiles = {}; // Changed files are in the copy queue, the lookup already handled the rest
             
+            CopyJournal FailJournal;
+            bool sourceFailed = false;
+            const std::string& SourceTopRootPath = SourceIndex::PathOf(sourceId);
             while (!FailCopyQueue.empty())
             {
-                const FileInfo& file = FailCopyQueue.front();
-                std::string SourceTopRootPath = FailCopyStateCache.GetPathFromSourceID(sourceId);
+                FileInfo& file = FailCopyQueue.front();
                 bool copySuccess = Copier.PerformFileCopy(file.AbsolutePath, SourceTopRootPath);
+                if (copySuccess)
+                {
+                    FailJournal.Record(sourceId, file);
+                    FailSourceCache.UpdateEntry(std::move(file)); // Saved only if the whole source copied
+                }
+                else
+                {
+                    sourceFailed = true;
+                }
                 FailCopyQueue.pop();
             }
 
+            if (sourceFailed)
+            {
+                FailJournal.Flush();
+                Log.Error(std::string("[Recovery] Not all files copied for source: ") + sourcePath);
+                overallSuccess = false;
+                continue;
+            }
+
             // Final flush and update copy state
-            FailCopyStateCache.MarkCopied(sourceId);
+            if (FailSourceCache.Save(sourceId))
+            {
+                FailJournal.Discard(sourceId);
+            }
+            else
+            {
+                Log.Error(std::string("[Recovery] Failed to save cache for source: ") + sourcePath);
+                FailJournal.Flush();
+            }
+            CopyState::MarkCopied(sourceId);
             std::cout << "Source Copied Successfully: \" "<< sourcePath << " \" \n";
             Log.Info(std::string("[Recovery] Source Copied Successfully:") + sourcePath);
         }
@@ -295,6 +330,7 @@ namespace FailureDetect
         {
             std::cout << "All Sources Recovered Successfully.\n";
             Log.Info(std::string("[Recovery] All Sources Recovered Successfully."));
+            CopyState::Flush();
             MarkSuccess();
             return true;
         }
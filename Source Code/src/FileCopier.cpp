@@ -1,6 +1,7 @@
 #include "FileCopier.hpp"
 #include "ConfigGlobal.hpp"
 #include "MetaDataCache.hpp"
+#include "CopyState.hpp"
 #include <filesystem>
 #include <fstream>
 #include <iostream>
@@ -78,6 +79,14 @@ inline std::wstring UTF8ToUTF16(const std::string& utf8)
 #include <unistd.h>
 #include <sys/stat.h>
 #include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/fs.h>
 
 inline std::filesystem::path NormalizeLongPath(const std::filesystem::path& path)
 {
@@ -120,21 +129,424 @@ namespace {
     };
 
     static CopyFileRangeInit InitCopyFileRangeSupport;
+}
+#endif
+
+constexpr size_t LARGE_FILE_THRESHOLD = 2ULL * 1024 * 1024 * 1024; //ULL = Unsigned Long Long
+
+#ifndef _WIN32
+constexpr size_t LARGE_COPY_CHUNK = 64ULL * 1024 * 1024; // Progress and cancellation granularity of large copies
+constexpr size_t COPY_BUFFER_SIZE = 1024 * 1024; // Per thread buffer of the read/write fallback
+constexpr uint64_t PREALLOCATE_MIN_SIZE = 1024 * 1024; // Smaller files end up in one extent anyway, not worth the extra call
+
+std::atomic<uint64_t> FileCopier::TierBytes[4] = {};
+std::atomic<uint64_t> FileCopier::HoleBytes = 0;
+std::mutex FileCopier::ReflinkMutex;
+std::map<std::pair<dev_t, dev_t>, bool> FileCopier::ReflinkPairs;
+
+namespace {
+    bool CopyFileRangeUnsupported(int error)
+    {
+        // Cross filesystem pairs, filesystems without support and kernels without the syscall
+        return error == EXDEV || error == EINVAL || error == ENOSYS || error == EOPNOTSUPP;
+    }
+
+    const uint64_t PAGE_SIZE_BYTES = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+    // Which pages of a source range were cached before the copy read them, so dropping the cache afterwards only evicts what the copy
+    // itself brought in and pages other applications had cached stay. A range that can't be mapped records nothing and drops nothing
+    struct CachedPages
+    {
+        uint64_t Offset = 0; // Page aligned
+        std::vector<unsigned char> Resident;
 
-    std::string escapeShellChars(const std::string& input) {
-        std::string output;
-        for (char c : input) {
-            if (c == '$' || c == '\\' || c == '"' || c == '`') {
-                output += '\\';  // escape shell special chars
+        void Record(int fd, uint64_t offset, uint64_t length)
+        {
+            Resident.clear();
+            Offset = offset / PAGE_SIZE_BYTES * PAGE_SIZE_BYTES;
+            size_t span = static_cast<size_t>(offset + length - Offset);
+            if (length == 0)
+            {
+                return;
+            }
+            void* map = mmap(nullptr, span, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(Offset));
+            if (map == MAP_FAILED)
+            {
+                return;
+            }
+            Resident.resize((span + PAGE_SIZE_BYTES - 1) / PAGE_SIZE_BYTES);
+            if (mincore(map, span, Resident.data()) != 0)
+            {
+                Resident.clear();
+            }
+            munmap(map, span);
+        }
+
+        void DropNew(int fd) const
+        {
+            size_t i = 0;
+            while (i < Resident.size())
+            {
+                if (Resident[i] & 1)
+                {
+                    ++i;
+                    continue;
+                }
+                size_t start = i;
+                while (i < Resident.size() && !(Resident[i] & 1))
+                {
+                    ++i;
+                }
+                posix_fadvise(fd, static_cast<off_t>(Offset + start * PAGE_SIZE_BYTES), static_cast<off_t>((i - start) * PAGE_SIZE_BYTES), POSIX_FADV_DONTNEED);
+            }
+        }
+    };
+
+    // Fewer blocks allocated than the size needs. Also true for compressed and inline files, those are found to be all data by SEEK_DATA
+    bool IsSparse(const struct stat& st)
+    {
+        return static_cast<uint64_t>(st.st_blocks) * 512 < static_cast<uint64_t>(st.st_size);
+    }
+
+    bool ReflinkUnsupported(int error)
+    {
+        // Different filesystems, filesystems without clone support(ext4 reports ENOTTY or EOPNOTSUPP) and kernels without FICLONE.
+        // Not EINVAL, that is also returned for a single file that can't be cloned(e.g. NOCOW source on btrfs) on a pair that can
+        return error == EXDEV || error == EOPNOTSUPP || error == ENOTTY || error == ENOSYS;
+    }
+
+    bool SendFileUnsupported(int error)
+    {
+        return error == EINVAL || error == ENOSYS || error == EOPNOTSUPP;
+    }
+
+    // Moves up to len bytes at the current offsets through a buffer reused by the calling copy thread.
+    // Returns the bytes moved, 0 at end of file, -1 on error
+    ssize_t ReadWriteChunk(int srcFd, int destFd, size_t len)
+    {
+        thread_local std::vector<char> buffer(COPY_BUFFER_SIZE);
+        ssize_t got = read(srcFd, buffer.data(), std::min(len, buffer.size()));
+        if (got <= 0)
+        {
+            return got;
+        }
+        ssize_t written = 0;
+        while (written < got)
+        {
+            ssize_t n = write(destFd, buffer.data() + written, static_cast<size_t>(got - written));
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                if (n == 0)
+                {
+                    errno = EIO;
+                }
+                return -1; // Part of the chunk is written, the offsets no longer match
             }
-            output += c;
+            written += n;
         }
-        return output;
+        return got;
     }
 }
-#endif
 
-constexpr size_t LARGE_FILE_THRESHOLD = 2ULL * 1024 * 1024 * 1024; //ULL = Unsigned Long Long
+// Tiers in order: copy_file_range(in kernel, reflink or server side copy where the filesystem can), sendfile(in kernel, works across
+// filesystems), read/write. A tier that is unsupported for this pair hands over to the next from the same offsets, a short transfer is
+// continued instead of taken as the end, only a 0 from sendfile or read/write means the source ended early.
+int FileCopier::CopyRange(int srcFd, int destFd, uint64_t length, CopyTier& tier, std::string& failedStep, uint64_t& moved)
+{
+    moved = 0;
+    while (moved < length)
+    {
+        size_t left = static_cast<size_t>(length - moved);
+        ssize_t step = 0;
+        if (tier == CopyTier::CopyFileRange)
+        {
+            step = copy_file_range(srcFd, nullptr, destFd, nullptr, left, 0);
+            if ((step < 0 && CopyFileRangeUnsupported(errno)) || step == 0)
+            {
+                // Nothing moved by this call. Some filesystems report 0 instead of an error, the next tier tells whether the source really ended
+                tier = CopyTier::SendFile;
+                continue;
+            }
+        }
+        else if (tier == CopyTier::SendFile)
+        {
+            step = sendfile(destFd, srcFd, nullptr, left);
+            if (step < 0 && SendFileUnsupported(errno))
+            {
+                tier = CopyTier::ReadWrite;
+                continue;
+            }
+        }
+        else
+        {
+            step = ReadWriteChunk(srcFd, destFd, left);
+        }
+
+        if (step < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            failedStep = tier == CopyTier::CopyFileRange ? "copy_file_range" : tier == CopyTier::SendFile ? "sendfile" : "read/write";
+            return errno;
+        }
+        if (step == 0)
+        {
+            return 0; // Source shrank while copying
+        }
+        moved += static_cast<uint64_t>(step);
+        TierBytes[static_cast<int>(tier)] += static_cast<uint64_t>(step);
+    }
+    return 0;
+}
+
+// Sparse sources are walked extent by extent with SEEK_DATA/SEEK_HOLE and only the data is copied, the destination is extended over
+// the holes so they stay unallocated. Everything else is copied front to back
+int FileCopier::CopyContents(int srcFd, int destFd, const struct stat& srcStat, const CopyProgress& progress, std::string& failedStep, CopyOutcome& outcome)
+{
+    uint64_t total = static_cast<uint64_t>(srcStat.st_size);
+    CopyTier tier = CopyFileRangeSupported ? CopyTier::CopyFileRange : CopyTier::SendFile;
+    bool sparse = IsSparse(srcStat);
+    outcome = {};
+
+    posix_fadvise(srcFd, 0, 0, POSIX_FADV_SEQUENTIAL); // Larger kernel read ahead for the source
+    // Reserves the final size up front so the file is laid out in few extents instead of growing write by write, and a full disk fails
+    // before any data is written. Filesystems without fallocate simply grow the file. Not for sparse files, it would allocate their holes
+    if (total >= PREALLOCATE_MIN_SIZE && !sparse && fallocate(destFd, 0, 0, static_cast<off_t>(total)) != 0 && errno != EOPNOTSUPP && errno != ENOSYS)
+    {
+        failedStep = "fallocate";
+        return errno;
+    }
+
+    uint64_t pos = 0;
+    while (pos < total)
+    {
+        uint64_t extentEnd = total;
+        if (sparse)
+        {
+            off_t data = lseek(srcFd, static_cast<off_t>(pos), SEEK_DATA);
+            if (data < 0)
+            {
+                if (errno != ENXIO)
+                {
+                    failedStep = "lseek";
+                    return errno;
+                }
+                // Only a hole is left up to the end of the file, unless the source shrank
+                struct stat now;
+                pos = (fstat(srcFd, &now) == 0) ? std::min(total, static_cast<uint64_t>(now.st_size)) : total;
+                break;
+            }
+            off_t hole = lseek(srcFd, data, SEEK_HOLE);
+            if (hole < 0 || lseek(srcFd, data, SEEK_SET) < 0 || lseek(destFd, data, SEEK_SET) < 0)
+            {
+                failedStep = "lseek";
+                return errno;
+            }
+            pos = static_cast<uint64_t>(data);
+            extentEnd = std::min(total, static_cast<uint64_t>(hole));
+        }
+
+        bool shrank = false;
+        CachedPages current;
+        CachedPages next;
+        bool recorded = false;
+        while (pos < extentEnd)
+        {
+            uint64_t chunk = std::min<uint64_t>(LARGE_COPY_CHUNK, extentEnd - pos);
+            // Residency is recorded before anything reads the range, the copy and read ahead of the chunk before it included
+            if (ConfigGlobal::DropPageCache && !recorded)
+            {
+                current.Record(srcFd, pos, chunk);
+            }
+            recorded = false;
+            if (pos + chunk < extentEnd)
+            {
+                // Reading the next chunk overlaps with writing this one
+                uint64_t nextLength = std::min<uint64_t>(LARGE_COPY_CHUNK, extentEnd - pos - chunk);
+                if (ConfigGlobal::DropPageCache)
+                {
+                    next.Record(srcFd, pos + chunk, nextLength);
+                    recorded = true;
+                }
+                posix_fadvise(srcFd, static_cast<off_t>(pos + chunk), static_cast<off_t>(nextLength), POSIX_FADV_WILLNEED);
+            }
+            uint64_t moved = 0;
+            int error = CopyRange(srcFd, destFd, chunk, tier, failedStep, moved);
+            if (ConfigGlobal::DropPageCache)
+            {
+                current.DropNew(srcFd);
+                std::swap(current, next);
+            }
+            if (error != 0)
+            {
+                if (recorded)
+                {
+                    current.DropNew(srcFd); // The next chunk, already read ahead
+                }
+                return error;
+            }
+            pos += moved;
+            outcome.DataBytes += moved;
+            if (moved < chunk)
+            {
+                shrank = true;
+                break;
+            }
+            if (progress && !progress(pos, total))
+            {
+                if (recorded)
+                {
+                    current.DropNew(srcFd);
+                }
+                failedStep = "cancelled";
+                return ECANCELED;
+            }
+        }
+        if (shrank)
+        {
+            break;
+        }
+    }
+    outcome.Length = pos;
+
+    // Sparse: covers a trailing hole, the destination so far only reaches the end of the last data extent.
+    // Shrunk source: drops the preallocated tail
+    if ((sparse || outcome.Length < total) && ftruncate(destFd, static_cast<off_t>(outcome.Length)) != 0)
+    {
+        failedStep = "ftruncate";
+        return errno;
+    }
+    if (sparse)
+    {
+        HoleBytes += outcome.Length - outcome.DataBytes;
+    }
+    return 0;
+}
+
+bool FileCopier::TryReflink(int srcFd, int destFd, const struct stat& srcStat)
+{
+    if (!ConfigGlobal::ReflinkCopy)
+    {
+        return false;
+    }
+    struct stat destStat;
+    if (fstat(destFd, &destStat) != 0)
+    {
+        return false;
+    }
+    // Not keyed on st_dev equality alone, btrfs subvolumes report different devices but clone between each other
+    std::pair<dev_t, dev_t> devices(srcStat.st_dev, destStat.st_dev);
+    bool known = false;
+    {
+        std::lock_guard lock(ReflinkMutex);
+        auto it = ReflinkPairs.find(devices);
+        if (it != ReflinkPairs.end())
+        {
+            if (!it->second)
+            {
+                return false;
+            }
+            known = true;
+        }
+    }
+
+    if (ioctl(destFd, FICLONE, srcFd) == 0)
+    {
+        TierBytes[static_cast<int>(CopyTier::Reflink)] += static_cast<uint64_t>(srcStat.st_size);
+        if (!known)
+        {
+            std::lock_guard lock(ReflinkMutex);
+            if (ReflinkPairs.emplace(devices, true).second)
+            {
+                Log.Info(std::string("[FileCopier] Reflink Supported, Cloning Files from Device ") + std::to_string(devices.first) +
+                    std::string(" to Device ") + std::to_string(devices.second));
+            }
+        }
+        return true;
+    }
+
+    int err = errno;
+    if (ReflinkUnsupported(err) && !known)
+    {
+        std::lock_guard lock(ReflinkMutex);
+        if (ReflinkPairs.emplace(devices, false).second)
+        {
+            Log.Info(std::string("[FileCopier] Reflink Not Supported from Device ") + std::to_string(devices.first) + std::string(" to Device ") +
+                std::to_string(devices.second) + std::string(" (") + strerror(err) + std::string("), Copying Contents"));
+        }
+    }
+    // Any other failure(a file that can't be cloned, out of space) falls back to the regular copy for this file only, which reports real errors
+    return false;
+}
+
+int FileCopier::CopyLargeFile(int srcFd, int destFd, const struct stat& srcStat, const CopyProgress& progress, std::string& failedStep, CopyOutcome& outcome)
+{
+    int error = CopyContents(srcFd, destFd, srcStat, progress, failedStep, outcome);
+    if (error != 0)
+    {
+        return error;
+    }
+    if ((error = CopyMetadata(destFd, srcStat)) != 0)
+    {
+        failedStep = "metadata";
+        return error;
+    }
+    if (fsync(destFd) != 0)
+    {
+        failedStep = "fsync";
+        return errno;
+    }
+    if (ConfigGlobal::DropPageCache)
+    {
+        posix_fadvise(destFd, 0, 0, POSIX_FADV_DONTNEED); // All clean after the fsync
+    }
+    return 0;
+}
+
+int FileCopier::CopyMetadata(int destFd, const struct stat& srcStat)
+{
+    // Changing the owner needs privileges, an unprivileged run keeps itself as the owner
+    if (fchown(destFd, srcStat.st_uid, srcStat.st_gid) != 0 && errno != EPERM)
+    {
+        return errno;
+    }
+    // After fchown, which clears setuid/setgid
+    if (fchmod(destFd, srcStat.st_mode & 07777) != 0)
+    {
+        return errno;
+    }
+    const timespec times[2] = { srcStat.st_atim, srcStat.st_mtim };
+    if (futimens(destFd, times) != 0)
+    {
+        return errno;
+    }
+    return 0;
+}
+
+void FileCopier::LogSparseCopy(const std::string& sourcePath, const CopyOutcome& outcome)
+{
+    if (outcome.DataBytes < outcome.Length)
+    {
+        Log.Info(std::string("[FileCopier] Sparse File: ") + sourcePath + std::string(" | Data Copied: ") + std::to_string(outcome.DataBytes) +
+            std::string(" of ") + std::to_string(outcome.Length) + std::string(" Bytes"));
+    }
+}
+
+void FileCopier::LogCopyStats()
+{
+    Log.Info(std::string("[FileCopier] Bytes Copied by copy_file_range: ") + std::to_string(TierBytes[static_cast<int>(CopyTier::CopyFileRange)].load() >> 20) +
+        std::string(" MB | sendfile: ") + std::to_string(TierBytes[static_cast<int>(CopyTier::SendFile)].load() >> 20) +
+        std::string(" MB | read/write: ") + std::to_string(TierBytes[static_cast<int>(CopyTier::ReadWrite)].load() >> 20) +
+        std::string(" MB | Reflink: ") + std::to_string(TierBytes[static_cast<int>(CopyTier::Reflink)].load() >> 20) +
+        std::string(" MB | Sparse Holes Skipped: ") + std::to_string(HoleBytes.load() >> 20) + std::string(" MB"));
+}
+#endif
 
 bool FileCopier::PerformFileCopy(const std::string& sourcePath, const std::string& SourceTopRootPath)
 {
@@ -251,9 +663,7 @@ bool FileCopier::PerformFileCopy(const std::string& sourcePath, const std::strin
             */
         }
 #else
-    std::string escapedDestPath = escapeShellChars(finalDestPath.string());
-
-	int srcFd = open(sourcePath.c_str(), O_RDONLY);
+        int srcFd = open(sourcePath.c_str(), O_RDONLY);
         if (srcFd < 0)
         {
             std::cerr << "[ERROR] Failed to open source file: " << sourcePath << "\n";
@@ -262,69 +672,76 @@ bool FileCopier::PerformFileCopy(const std::string& sourcePath, const std::strin
         }
 
         int destFd = open(finalDestPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (destFd < 0 && errno == EACCES)
+        {
+            // The copy of a read only source is read only itself(the mode is applied after the contents), replace it instead of writing into it
+            if (unlink(finalDestPath.c_str()) == 0)
+            {
+                destFd = open(finalDestPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            }
+        }
         if (destFd < 0)
         {
-            Log.Error(std::string("[FileCopier] Failed to Open/Close Destination File") + escapedDestPath);
+            Log.Error(std::string("[FileCopier] Failed to Open/Close Destination File") + finalDestPath.string());
             close(srcFd);
             return false;
         }
 
-         if (fileSize >= LARGE_FILE_THRESHOLD)
+        struct stat statBuf;
+        if (fstat(srcFd, &statBuf) != 0)
         {
-            // Use dd for content copy with progress
-            std::string ddCmd = "dd if=\"" + escapeShellChars(sourcePath) + "\" of=\"" + escapedDestPath + "\" bs=4M status=progress conv=fsync";
-            int ret = std::system(ddCmd.c_str());
-            if (ret != 0)
-            {
-                std::cerr << "[ERROR] dd command failed with exit code: " << ret << "\n";
-                close(srcFd);
-                close(destFd);
-                HandleCopyFailure(sourcePath, "dd failed", ret);
-                return false;
-            }
+            int err = errno;
+            close(srcFd);
+            close(destFd);
+            HandleCopyFailure(sourcePath, "fstat failed", err);
+            return false;
+        }
 
-            // Copy metadata separately
-            std::string cpAttrCmd = "cp --attributes-only --preserve=mode,ownership,timestamps \"" + escapeShellChars(sourcePath) + "\" \"" + escapedDestPath + "\"";
-            ret = std::system(cpAttrCmd.c_str());
-            if (ret != 0)
+        // A clone shares the source's blocks, only the metadata is left to copy
+        bool cloned = TryReflink(srcFd, destFd, statBuf);
+        if (!cloned && fileSize >= LARGE_FILE_THRESHOLD)
+        {
+            auto start = std::chrono::steady_clock::now();
+            auto progress = [](uint64_t copied, uint64_t total)
+            {
+                std::cout << "\r[COPY] " << (copied >> 20) << " / " << (total >> 20) << " MB" << std::flush;
+                return true;
+            };
+            std::string failedStep;
+            CopyOutcome outcome;
+            int err = CopyLargeFile(srcFd, destFd, statBuf, progress, failedStep, outcome);
+            std::cout << "\n";
+            if (err != 0)
             {
-                std::cerr << "[ERROR] cp attributes command failed with exit code: " << ret << "\n";
+                std::cerr << "[ERROR] Large file copy failed at " << failedStep << ": " << strerror(err) << "\n";
                 close(srcFd);
                 close(destFd);
-                HandleCopyFailure(sourcePath, "cp attributes failed", ret);
+                HandleCopyFailure(sourcePath, std::string("Large file copy failed at ") + failedStep, err);
                 return false;
             }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            Log.Info(std::string("[FileCopier] Large File Copied: ") + std::to_string(statBuf.st_size >> 20) + std::string(" MB in ") +
+                std::to_string(seconds) + std::string(" s (") + std::to_string(seconds > 0 ? (statBuf.st_size >> 20) / seconds : 0.0) + std::string(" MB/s)"));
+            LogSparseCopy(sourcePath, outcome);
         }
         else
         {
-            if (CopyFileRangeSupported)
+            std::string failedStep;
+            CopyOutcome outcome;
+            int err = cloned ? 0 : CopyContents(srcFd, destFd, statBuf, nullptr, failedStep, outcome);
+            if (err == 0 && (err = CopyMetadata(destFd, statBuf)) != 0)
             {
-                struct stat statBuf;
-                fstat(srcFd, &statBuf);
-                ssize_t copied = copy_file_range(srcFd, nullptr, destFd, nullptr, statBuf.st_size, 0);
-                if (copied < 0)
-                {
-                        std::cerr << "[ERROR] copy_file_range failed: " << strerror(errno) << "\n";
-                        close(srcFd);
-                        close(destFd);
-                        HandleCopyFailure(sourcePath, "copy faile range failed", errno);
-                        return false;
-                }
+                failedStep = "metadata";
             }
-            else
+            if (err != 0)
             {
-                // fallback to cp to copy content+metadata
-                std::string cpCmd = "cp --preserve=mode,ownership,timestamps \"" + escapeShellChars(sourcePath) + "\" \"" + escapedDestPath + "\"";
-                int ret = std::system(cpCmd.c_str());
-                if (ret != 0)
-                {
-                    std::cerr << "[ERROR] cp fallback command failed with exit code: " << ret << "\n";
-                    close(srcFd);
-                    close(destFd);
-                    HandleCopyFailure(sourcePath, "cp failed", ret);
-                    return false;
-                }
+                std::cerr << "[ERROR] File copy failed at " << failedStep << ": " << strerror(err) << "\n";
+                close(srcFd);
+                close(destFd);
+                HandleCopyFailure(sourcePath, std::string("File copy failed at ") + failedStep, err);
+                return false;
             }
+            LogSparseCopy(sourcePath, outcome);
         }
 
         close(srcFd);
@@ -427,9 +844,7 @@ void FileCopier::HandleCopyFailure(const std::string& FilePath, const std::strin
 {
     Log.Error(std::string("[FileCopier] Copy Failed: ") + FilePath + std::string(" | Code: ") + std::to_string(ErrorCode) + std::string(" | Reason: ") + Reason);
 
-    MetaDataCache Cache;
-    Cache.LoadCopiedState();
-    Cache.SaveCopiedState();
+    CopyState::Flush();
     std::cerr << "[NOTICE] The current sync state has been saved.\n" << "You can resume copying the remaining files by running the program again after resolving error.\n\n";
     Log.Info(std::string("Sync State Saved, file probably not copied due to I/O Problems"));
     std::exit(EXIT_FAILURE);
@@ -2,40 +2,132 @@
 #include "Logger.hpp"
 #include "ConfigGlobal.hpp"
 #include "Blake3/blake3.h"
+#include "Blake3/blake3_impl.h"
 #include <thread>
-#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 #include <cstring>
 #include <vector>
 #include <string>
 #include <iostream>
+#include <chrono>
+#include <atomic>
+#include <array>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
 
 void FileHasher::HashFiles(std::vector<FileInfo>& files)
 {
-    Log.Info(std::string("Starting hashing of ") + std::to_string(files.size()) + std::string(" files using ") + std::to_string(ConfigGlobal::ThreadCount) + std::string(" threads."));
-    std::vector<std::future<void>> futures;
+    HashFiles(files, ConfigGlobal::ChangeDetection == "Content");
+}
 
-    size_t filesCount = files.size();
-    size_t chunkSize = (filesCount + ConfigGlobal::ThreadCount - 1) / ConfigGlobal::ThreadCount;
+void FileHasher::HashFiles(std::vector<FileInfo>& files, bool content)
+{
+    Log.Info(std::string("Starting hashing of ") + std::to_string(files.size()) + std::string(" files using ") + std::to_string(SharedPoolThreadCount()) + std::string(" shared threads."));
+    auto StartTime = std::chrono::steady_clock::now();
 
-    for (size_t t = 0; t < ConfigGlobal::ThreadCount; ++t) // Divide the files into chunks for multi-threaded hashing.
+    // Metadata hashes are cheap, claim them in larger chunks to keep the atomic off the hot path
+    size_t grain = content ? 1 : 256;
+    ParallelFor(files.size(), grain, [this, &files, content](size_t begin, size_t end)
     {
-        size_t start = t * chunkSize;
-        if (start >= filesCount) break;
+        for (size_t i = begin; i < end; ++i)
+        {
+            HashSingleFile(files[i], content);
+        }
+    });
+
+    // Throughput per call, compare builds with and without BLAKE3_SIMD(SIMD degree 1 = portable kernel)
+    auto ElapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - StartTime).count();
+    Log.Info(std::string("[FileHasher] Hashed ") + std::to_string(files.size()) + std::string(" files in ") + std::to_string(ElapsedUs) +
+        std::string(" us | BLAKE3 SIMD degree: ") + std::to_string(blake3_simd_degree()));
+}
 
-        size_t end = std::min(start + chunkSize, filesCount);
+// One pool for all hashing in the process, sized by the Mode thread count. Sources hashing at the same time share it instead of each
+// starting ThreadCount threads of their own
+size_t FileHasher::SharedPoolThreadCount()
+{
+    return std::max<size_t>(ConfigGlobal::ThreadCount, 1);
+}
+
+ThreadPool& FileHasher::SharedPool()
+{
+    static ThreadPool Pool(SharedPoolThreadCount());
+    return Pool;
+}
 
-        futures.emplace_back(std::async(std::launch::async, [this, &files, start, end]() {
-        for (size_t i = start; i < end; ++i)
+// Runs Body over [0, Count) in chunks of Grain claimed from an atomic index. The calling thread claims chunks too and only waits for chunks
+// already being worked on, so nested calls(a large file inside a batch) and a busy pool can never deadlock, helpers that start after
+// everything is claimed return immediately
+void FileHasher::ParallelFor(size_t Count, size_t Grain, std::function<void(size_t, size_t)> Body)
+{
+    if (Count == 0)
+    {
+        return;
+    }
+
+    struct ParallelJob
+    {
+        std::atomic<size_t> Next{ 0 };
+        std::atomic<size_t> Done{ 0 };
+        size_t Count = 0;
+        size_t Grain = 1;
+        std::function<void(size_t, size_t)> Body;
+        std::mutex JobMutex;
+        std::condition_variable Done_CV;
+    };
+
+    auto Job = std::make_shared<ParallelJob>();
+    Job->Count = Count;
+    Job->Grain = std::max<size_t>(Grain, 1);
+    Job->Body = std::move(Body);
+
+    auto Run = [Job]()
+    {
+        while (true)
         {
-            HashSingleFile(files[i]);
+            size_t Begin = Job->Next.fetch_add(Job->Grain);
+            if (Begin >= Job->Count)
+            {
+                return;
+            }
+            size_t End = std::min(Begin + Job->Grain, Job->Count);
+            Job->Body(Begin, End);
+            if (Job->Done.fetch_add(End - Begin) + (End - Begin) == Job->Count)
+            {
+                std::lock_guard<std::mutex> Lock(Job->JobMutex);
+                Job->Done_CV.notify_all();
+            }
         }
-        }));
+    };
+
+    size_t Chunks = (Count + Job->Grain - 1) / Job->Grain;
+    size_t Helpers = std::min(SharedPoolThreadCount(), Chunks - 1);
+    for (size_t i = 0; i < Helpers; ++i)
+    {
+        SharedPool().Submit(Run);
     }
-    for (auto& f : futures) f.get();
+    Run();
+
+    std::unique_lock<std::mutex> Lock(Job->JobMutex);
+    Job->Done_CV.wait(Lock, [&Job]() { return Job->Done.load() == Job->Count; });
 }
 
 void FileHasher::HashSingleFile(FileInfo& file)
 {
+    HashSingleFile(file, ConfigGlobal::ChangeDetection == "Content");
+}
+
+void FileHasher::HashSingleFile(FileInfo& file, bool content)
+{
+    if (content)
+    {
+        HashFileContent(file);
+        return;
+    }
+    file.ContentHashed = false;
+
     std::vector<uint8_t> buffer;
 
     const std::string& path = file.AbsolutePath;
@@ -60,3 +152,187 @@ void FileHasher::HashSingleFile(FileInfo& file)
     std::memcpy(file.Hash.data(), outHash, sizeof(outHash));
 }
 
+namespace
+{
+    constexpr size_t SMALL_FILE_READ_LIMIT = 8ULL * 1024 * 1024; // Files up to this size are read with a single read and hashed on the calling thread
+    constexpr size_t CONTENT_SEGMENT_SIZE = 4ULL * 1024 * 1024; // Large files are split into BLAKE3 subtrees of this size(must be a power of 2 multiple of BLAKE3_CHUNK_LEN)
+
+    static_assert(CONTENT_SEGMENT_SIZE % BLAKE3_CHUNK_LEN == 0 && ((CONTENT_SEGMENT_SIZE / BLAKE3_CHUNK_LEN) & (CONTENT_SEGMENT_SIZE / BLAKE3_CHUNK_LEN - 1)) == 0,
+        "CONTENT_SEGMENT_SIZE must be a power of 2 number of BLAKE3 chunks");
+
+    using ChainingValue = std::array<uint8_t, BLAKE3_OUT_LEN>;
+
+    struct Segment
+    {
+        uint64_t Offset = 0;
+        uint64_t Length = 0;
+    };
+
+    std::filesystem::path ToPath(const std::string& Utf8Path)
+    {
+        return std::filesystem::path(std::u8string(Utf8Path.begin(), Utf8Path.end()));
+    }
+
+    bool ReadRange(std::ifstream& Stream, uint64_t Offset, uint8_t* Buffer, uint64_t Length)
+    {
+        Stream.seekg(static_cast<std::streamoff>(Offset));
+        Stream.read(reinterpret_cast<char*>(Buffer), static_cast<std::streamsize>(Length));
+        return static_cast<uint64_t>(Stream.gcount()) == Length;
+    }
+
+    // Same split as BLAKE3 itself, the left subtree holds the largest power of 2 number of chunks that leaves at least 1 byte on the right
+    uint64_t LeftSubtreeLength(uint64_t Length)
+    {
+        uint64_t FullChunks = (Length - 1) / BLAKE3_CHUNK_LEN;
+        uint64_t PowerOf2 = 1;
+        while (PowerOf2 * 2 <= FullChunks)
+        {
+            PowerOf2 *= 2;
+        }
+        return PowerOf2 * BLAKE3_CHUNK_LEN;
+    }
+
+    ChainingValue ParentNode(const uint8_t* LeftRight, uint8_t Flags)
+    {
+        uint32_t Words[8];
+        std::memcpy(Words, IV, sizeof(Words));
+        blake3_compress_in_place(Words, LeftRight, BLAKE3_BLOCK_LEN, 0, static_cast<uint8_t>(Flags | PARENT));
+        ChainingValue Out;
+        store_cv_words(Out.data(), Words);
+        return Out;
+    }
+
+    ChainingValue ParentNode(const ChainingValue& Left, const ChainingValue& Right, uint8_t Flags)
+    {
+        uint8_t Block[BLAKE3_BLOCK_LEN];
+        std::memcpy(Block, Left.data(), BLAKE3_OUT_LEN);
+        std::memcpy(Block + BLAKE3_OUT_LEN, Right.data(), BLAKE3_OUT_LEN);
+        return ParentNode(Block, Flags);
+    }
+
+    // Non root chaining value of the subtree starting at ChunkCounter, reduced the same way blake3_hasher_update does
+    ChainingValue SubtreeChainingValue(const uint8_t* Input, size_t Length, uint64_t ChunkCounter)
+    {
+        uint8_t CVs[2 * MAX_SIMD_DEGREE_OR_2 * BLAKE3_OUT_LEN];
+        size_t Count = blake3_compress_subtree_wide(Input, Length, IV, ChunkCounter, 0, CVs, false);
+        while (Count > 2)
+        {
+            size_t Pairs = Count / 2;
+            for (size_t i = 0; i < Pairs; ++i)
+            {
+                ChainingValue Parent = ParentNode(CVs + 2 * i * BLAKE3_OUT_LEN, 0);
+                std::memcpy(CVs + i * BLAKE3_OUT_LEN, Parent.data(), BLAKE3_OUT_LEN);
+            }
+            if (Count % 2)
+            {
+                std::memmove(CVs + Pairs * BLAKE3_OUT_LEN, CVs + (Count - 1) * BLAKE3_OUT_LEN, BLAKE3_OUT_LEN);
+            }
+            Count = Pairs + Count % 2;
+        }
+        if (Count == 2)
+        {
+            return ParentNode(CVs, 0);
+        }
+        ChainingValue Out;
+        std::memcpy(Out.data(), CVs, BLAKE3_OUT_LEN);
+        return Out;
+    }
+
+    void CollectSegments(uint64_t Offset, uint64_t Length, std::vector<Segment>& Segments)
+    {
+        if (Length <= CONTENT_SEGMENT_SIZE)
+        {
+            Segments.push_back({ Offset, Length });
+            return;
+        }
+        uint64_t Left = LeftSubtreeLength(Length);
+        CollectSegments(Offset, Left, Segments);
+        CollectSegments(Offset + Left, Length - Left, Segments);
+    }
+
+    ChainingValue CombineSegments(uint64_t Length, const std::vector<ChainingValue>& SegmentCVs, size_t& Next)
+    {
+        if (Length <= CONTENT_SEGMENT_SIZE)
+        {
+            return SegmentCVs[Next++];
+        }
+        uint64_t Left = LeftSubtreeLength(Length);
+        ChainingValue LeftCV = CombineSegments(Left, SegmentCVs, Next);
+        ChainingValue RightCV = CombineSegments(Length - Left, SegmentCVs, Next);
+        return ParentNode(LeftCV, RightCV, 0);
+    }
+}
+
+// Hashes the file contents into FileInfo::Hash(first 16 bytes of the BLAKE3 digest).
+// Small files are read with one read and hashed in place. Large files are cut into aligned BLAKE3 subtrees that are read and hashed
+// on separate threads, their chaining values are then merged up to the root, giving the exact same digest as a sequential BLAKE3 of the file.
+void FileHasher::HashFileContent(FileInfo& file)
+{
+    file.Hash.fill(0);
+    file.ContentHashed = false;
+
+    std::ifstream Stream(ToPath(file.AbsolutePath), std::ios::binary);
+    if (!Stream)
+    {
+        Log.Error(std::string("[FileHasher] Failed to open file for content hashing: ") + file.AbsolutePath);
+        return;
+    }
+
+    uint64_t Size = file.Size;
+    uint8_t outHash[16] = { 0 };
+
+    if (Size <= SMALL_FILE_READ_LIMIT)
+    {
+        thread_local std::vector<uint8_t> Buffer;
+        Buffer.resize(Size);
+        if (!ReadRange(Stream, 0, Buffer.data(), Size))
+        {
+            Log.Error(std::string("[FileHasher] Failed to read file for content hashing: ") + file.AbsolutePath);
+            return;
+        }
+        blake3_hasher hasher;
+        blake3_hasher_init(&hasher);
+        blake3_hasher_update(&hasher, Buffer.data(), Buffer.size());
+        blake3_hasher_finalize(&hasher, outHash, sizeof(outHash));
+        std::memcpy(file.Hash.data(), outHash, sizeof(outHash));
+        file.ContentHashed = true;
+        return;
+    }
+    Stream.close();
+
+    std::vector<Segment> Segments;
+    CollectSegments(0, Size, Segments);
+    std::vector<ChainingValue> SegmentCVs(Segments.size());
+
+    std::atomic<bool> Failed{ false };
+    ParallelFor(Segments.size(), 1, [&](size_t begin, size_t end)
+    {
+        thread_local std::vector<uint8_t> Buffer;
+        Buffer.resize(CONTENT_SEGMENT_SIZE);
+        std::ifstream SegmentStream(ToPath(file.AbsolutePath), std::ios::binary);
+        for (size_t Index = begin; Index < end && !Failed; ++Index)
+        {
+            const Segment& Part = Segments[Index];
+            if (!SegmentStream || !ReadRange(SegmentStream, Part.Offset, Buffer.data(), Part.Length))
+            {
+                Failed = true;
+                break;
+            }
+            SegmentCVs[Index] = SubtreeChainingValue(Buffer.data(), static_cast<size_t>(Part.Length), Part.Offset / BLAKE3_CHUNK_LEN);
+        }
+    });
+
+    if (Failed)
+    {
+        Log.Error(std::string("[FileHasher] Failed to read file for content hashing: ") + file.AbsolutePath);
+        return;
+    }
+
+    uint64_t Left = LeftSubtreeLength(Size);
+    size_t Next = 0;
+    ChainingValue LeftCV = CombineSegments(Left, SegmentCVs, Next);
+    ChainingValue RightCV = CombineSegments(Size - Left, SegmentCVs, Next);
+    ChainingValue Root = ParentNode(LeftCV, RightCV, ROOT);
+    std::memcpy(file.Hash.data(), Root.data(), sizeof(outHash));
+    file.ContentHashed = true;
+}
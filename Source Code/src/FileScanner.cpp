@@ -1,10 +1,19 @@
 #include <iostream>
 #include <filesystem>
 #include <stack>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <iterator>
+#include <memory>
 
 #include "FileScanner.hpp"
 #include "TimeUtils.hpp"
 #include "Logger.hpp"
+#include "ConfigGlobal.hpp"
+#include "IOUringStatx.hpp"
 
 namespace FS = std::filesystem;
 
@@ -40,6 +49,14 @@ inline FS::path NormalizeLongPath(const FS::path& path)
 
 #else
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <cerrno>
+#include <cstring>
+
 inline FS::path NormalizeLongPath(const FS::path& path)
 {
     return path;
@@ -47,38 +64,102 @@ inline FS::path NormalizeLongPath(const FS::path& path)
 
 #endif
 
+#ifdef __linux__
+
+// Layout returned by the getdents64 syscall, not exposed by older glibc headers
+struct LinuxDirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+constexpr size_t DIRENT_BUFFER_SIZE = 64 * 1024;
+
+bool FileScanner::StatxSupported = true;
+
+void FileScanner::CheckStatxSupport()
+{
+    struct statx Stx;
+    if (statx(AT_FDCWD, "/", AT_SYMLINK_NOFOLLOW, STATX_TYPE, &Stx) != 0 && errno == ENOSYS)
+    {
+        StatxSupported = false;
+        Log.Info(std::string("[File Scanner] statx not supported, using std::filesystem scan"));
+    }
+}
+
+namespace {
+    struct StatxInit
+    {
+        StatxInit()
+        {
+            FileScanner::CheckStatxSupport();
+        }
+    };
+
+    static StatxInit InitStatxSupport;
+}
+
+#endif
+
 const std::vector<ScannedFileInfo>& FileScanner::GetFiles() const
 {
     return Files;
 }
 
+const PathArena& FileScanner::GetPaths() const
+{
+    return Paths;
+}
+
 void FileScanner::Clear()
 {
     Files.clear();
+    DirRecords.clear();
+    Paths.Clear();
+}
+
+void FileScanner::SetPreviousDirectoryIndex(DirectoryIndex&& Previous)
+{
+    PreviousDirRecords = std::move(Previous);
+}
+
+void FileScanner::SetBatchCallback(size_t Size, std::function<void(std::vector<ScannedFileInfo>&&)> Callback)
+{
+    BatchSize = Size;
+    BatchCallback = std::move(Callback);
+}
+
+const DirectoryRecordList& FileScanner::GetDirectoryRecords() const
+{
+    return DirRecords;
 }
 
 void FileScanner::SetExcludes(const std::vector<std::string>& ExcludePaths)
 {
-    Excludes = ExcludePaths;
+    Excludes.Compile(ExcludePaths);
 }
 
-bool FileScanner::IsExcluded(const FS::path& Path) const
+bool FileScanner::IsExcluded(const FS::path& Path, bool IsDirectory) const
 {
-    const std::string Abs = FS::absolute(Path).string();
-    for (const auto& Exclude : Excludes)
+    if (Excludes.Empty())
     {
-        if (Abs == Exclude)
-        {
-            return true;
-        }
+        return false;
     }
-    return false;
+#ifdef _WIN32
+    return Excludes.Matches(Path.string(), IsDirectory);
+#else
+    return Excludes.Matches(Path.native(), IsDirectory);
+#endif
 }
 
 void FileScanner::Scan(const std::string& RootPath)
 {
     FS::path Root(RootPath);
     Root = NormalizeLongPath(Root);
+    ScanStartTime = ToTimeT(FS::file_time_type::clock::now());
     try
     {
         if (!FS::exists(Root))
@@ -87,7 +168,7 @@ void FileScanner::Scan(const std::string& RootPath)
             Log.Error("Scan: Path does not exist: " + Root.string());
             return;
         }
-        if (IsExcluded(Root))
+        if (IsExcluded(Root, FS::is_directory(Root)))
         {
             std::cerr << "Skipping excluded root path: " << Root.string() << "\n";
             Log.Error("Skipping excluded root path : " + Root.string());
@@ -96,20 +177,26 @@ void FileScanner::Scan(const std::string& RootPath)
         if (FS::is_regular_file(Root)) // Single file case
         {
             ScannedFileInfo Info;
-            Info.RelativePath = Root.string(); // Just the filename for single file
+            Info.DirID = Paths.InternDirectory(Root.parent_path().string());
+            Info.Name = Paths.StoreName(Root.filename().string());
             Info.Size = FS::file_size(Root);
             Info.MTime = ToTimeT(FS::last_write_time(Root));
             Files.push_back(std::move(Info));
-            return;
         }
-        if (!FS::is_directory(Root))
+        else if (!FS::is_directory(Root))
         {
             std::cerr << "Scan Error: Path is neither a directory nor a file: " << Root.string() << "\n";
             Log.Error("Scan Error: Path is neither a directory nor a file: " + Root.string());
             return;
         }
-        // Directory case
-        ScanDirectoryIterative(Root);
+        else if (ConfigGlobal::ParallelScanThreadCount > 1) // Directory case
+        {
+            ScanDirectoryParallel(Root, ConfigGlobal::ParallelScanThreadCount);
+        }
+        else
+        {
+            ScanDirectoryIterative(Root);
+        }
     }
     catch (const FS::filesystem_error& e)
     {
@@ -118,69 +205,468 @@ void FileScanner::Scan(const std::string& RootPath)
         std::cerr << "Path: " << e.path1() << "\n";
         Log.Error(std::string("Path: ") + e.path1().string());
     }
+    FlushBatch(Files, 1);
+}
+
+// Hands scanned files to the batch consumer once BatchSize is reached, no-op when no consumer is set(files stay in GetFiles())
+// Called from every parallel worker with its own vector, the consumer must be thread safe
+void FileScanner::FlushBatch(std::vector<ScannedFileInfo>& Out, size_t MinSize) const
+{
+    if (!BatchCallback || Out.empty() || Out.size() < MinSize)
+    {
+        return;
+    }
+    BatchCallback(std::move(Out));
+    Out.clear();
 }
 
 void FileScanner::ScanDirectoryIterative(const FS::path& Root)
 {
     std::stack<FS::path> DirStack;
+    std::vector<FS::path> SubDirs;
     DirStack.push(Root);
     while (!DirStack.empty())
     {
         FS::path Current = DirStack.top();
         DirStack.pop();
 
-        if (IsExcluded(Current))
+        SubDirs.clear();
+        ScanSingleDirectory(Current, SubDirs, Files, DirRecords);
+        FlushBatch(Files, BatchSize);
+        for (auto& Dir : SubDirs)
         {
-            std::cerr << "Skipping Excluded Directory: " << Current << "\n";
-            Log.Info(std::string("Skipping Excluded Directory: ") + Current.string());
-            continue;
+            DirStack.push(std::move(Dir));
         }
-        try
+    }
+}
+
+// Work stealing walk of a single source, each worker owns a deque of directories and its own output vector.
+// Owner pops from the back (depth first, cache friendly), idle workers steal from the front of other deques (large subtrees).
+// Outputs are merged after all workers join, so no lock is taken on the result list. Workers with nothing to steal sleep until a directory
+// is queued or the walk is done.
+void FileScanner::ScanDirectoryParallel(const FS::path& Root, size_t WorkerCount)
+{
+    struct ScanWorkerState
+    {
+        std::mutex DequeMutex;
+        std::deque<FS::path> Queue;
+        std::vector<ScannedFileInfo> Files;
+        DirectoryRecordList Dirs;
+    };
+
+    std::vector<ScanWorkerState> Workers(WorkerCount);
+    std::atomic<size_t> PendingDirs = 1; // Queued + in progress directories, walk is done when this hits 0
+    std::atomic<size_t> QueuedDirs = 1; // Directories sitting in a deque
+    std::atomic<size_t> IdleWorkers = 0;
+    std::mutex IdleMutex;
+    std::condition_variable IdleCV;
+    Workers[0].Queue.push_back(Root);
+
+    // Taking the mutex orders the wake up after a worker that checked the condition but is not waiting yet
+    auto WakeIdle = [&IdleWorkers, &IdleMutex, &IdleCV]()
+    {
+        if (IdleWorkers.load() > 0)
+        {
+            {
+                std::lock_guard<std::mutex> Lock(IdleMutex);
+            }
+            IdleCV.notify_all();
+        }
+    };
+
+    auto WorkerLoop = [this, &Workers, &PendingDirs, &QueuedDirs, &IdleWorkers, &IdleMutex, &IdleCV, &WakeIdle, WorkerCount](size_t Self)
+    {
+        ScanWorkerState& Own = Workers[Self];
+        std::vector<FS::path> SubDirs;
+
+        while (true)
         {
-            FS::path normCurrent = NormalizeLongPath(Current);
-            for (const auto& Entry : FS::directory_iterator(normCurrent))
+            FS::path Current;
+            bool Found = false;
             {
-                try
+                std::lock_guard<std::mutex> Lock(Own.DequeMutex);
+                if (!Own.Queue.empty())
                 {
-                    FS::path AbsPath = Entry.path();
-                    AbsPath = NormalizeLongPath(AbsPath);
-                    // Skip symbolic links to avoid loops or unsupported files.
-                    if (FS::is_symlink(Entry.symlink_status()))
-                    {
-                        Log.Info(std::string("Skipping SymLink: ") + AbsPath.string());
-                        continue;
-                    }
-                    if (IsExcluded(AbsPath))
-                    {
-                        std::cerr << "Skipping Excluded Path: " << AbsPath << "\n";
-                        Log.Info(std::string("Skipping Excluded Path: ") + AbsPath.string());
-                        continue;
-                    }
-                    if (Entry.is_directory())
+                    Current = std::move(Own.Queue.back());
+                    Own.Queue.pop_back();
+                    --QueuedDirs;
+                    Found = true;
+                }
+            }
+            for (size_t i = 1; !Found && i < WorkerCount; ++i)
+            {
+                ScanWorkerState& Victim = Workers[(Self + i) % WorkerCount];
+                std::lock_guard<std::mutex> Lock(Victim.DequeMutex);
+                if (!Victim.Queue.empty())
+                {
+                    Current = std::move(Victim.Queue.front());
+                    Victim.Queue.pop_front();
+                    --QueuedDirs;
+                    Found = true;
+                }
+            }
+            if (!Found)
+            {
+                std::unique_lock<std::mutex> Lock(IdleMutex);
+                ++IdleWorkers;
+                IdleCV.wait(Lock, [&QueuedDirs, &PendingDirs]() { return QueuedDirs.load() > 0 || PendingDirs.load() == 0; });
+                --IdleWorkers;
+                if (PendingDirs.load() == 0)
+                {
+                    return;
+                }
+                continue;
+            }
+
+            SubDirs.clear();
+            try
+            {
+                ScanSingleDirectory(Current, SubDirs, Own.Files, Own.Dirs);
+                FlushBatch(Own.Files, BatchSize);
+            }
+            catch (const std::exception& e)
+            {
+                // Filesystem errors are handled per entry inside, anything else(e.g. bad_alloc) skips the directory but must not stall the walk
+                std::cerr << "Error scanning directory: " << e.what() << " Path: " << Current << "\n";
+                Log.Error(std::string("Error scanning directory: ") + e.what() + std::string(" Path: ") + Current.string());
+            }
+            catch (...)
+            {
+                std::cerr << "Unknown error scanning directory: " << Current << "\n";
+                Log.Error(std::string("Unknown error scanning directory: ") + Current.string());
+            }
+            if (!SubDirs.empty())
+            {
+                PendingDirs += SubDirs.size(); // Increment before the decrement below so the count never touches 0 early
+                QueuedDirs += SubDirs.size(); // Before the push, a stealer must not take it below 0
+                {
+                    std::lock_guard<std::mutex> Lock(Own.DequeMutex);
+                    for (auto& Dir : SubDirs)
                     {
-                        DirStack.push(AbsPath);
+                        Own.Queue.push_back(std::move(Dir));
                     }
-                    else if (Entry.is_regular_file())
+                }
+                WakeIdle();
+            }
+            if (--PendingDirs == 0)
+            {
+                WakeIdle();
+            }
+        }
+    };
+
+    std::vector<std::thread> Threads;
+    Threads.reserve(WorkerCount - 1);
+    for (size_t i = 1; i < WorkerCount; ++i)
+    {
+        Threads.emplace_back(WorkerLoop, i);
+    }
+    WorkerLoop(0);
+    for (auto& Thread : Threads)
+    {
+        Thread.join();
+    }
+
+    for (auto& Worker : Workers)
+    {
+        FlushBatch(Worker.Files, 1); // Streaming mode, remainders go to the consumer and the merge below moves nothing
+    }
+
+    size_t Total = Files.size();
+    for (const auto& Worker : Workers)
+    {
+        Total += Worker.Files.size();
+    }
+    Files.reserve(Total);
+    for (auto& Worker : Workers)
+    {
+        std::move(Worker.Files.begin(), Worker.Files.end(), std::back_inserter(Files));
+        std::move(Worker.Dirs.begin(), Worker.Dirs.end(), std::back_inserter(DirRecords));
+    }
+}
+
+void FileScanner::ScanSingleDirectory(const FS::path& Current, std::vector<FS::path>& SubDirs, std::vector<ScannedFileInfo>& Out, DirectoryRecordList& DirsOut) const
+{
+    if (IsExcluded(Current, true))
+    {
+        std::cerr << "Skipping Excluded Directory: " << Current << "\n";
+        Log.Info(std::string("Skipping Excluded Directory: ") + Current.string());
+        return;
+    }
+#ifdef __linux__
+    if (StatxSupported)
+    {
+        ScanSingleDirectoryRaw(Current, SubDirs, Out, DirsOut);
+        return;
+    }
+#endif
+    try
+    {
+        FS::path normCurrent = NormalizeLongPath(Current);
+        std::string LastDir; // Every entry normally has the same parent, only intern again if normalization changed it
+        uint32_t LastDirID = 0;
+        for (const auto& Entry : FS::directory_iterator(normCurrent))
+        {
+            try
+            {
+                FS::path AbsPath = Entry.path();
+                AbsPath = NormalizeLongPath(AbsPath);
+                // Skip symbolic links to avoid loops or unsupported files.
+                if (FS::is_symlink(Entry.symlink_status()))
+                {
+                    Log.Info(std::string("Skipping SymLink: ") + AbsPath.string());
+                    continue;
+                }
+                if (IsExcluded(AbsPath, Entry.is_directory()))
+                {
+                    std::cerr << "Skipping Excluded Path: " << AbsPath << "\n";
+                    Log.Info(std::string("Skipping Excluded Path: ") + AbsPath.string());
+                    continue;
+                }
+                if (Entry.is_directory())
+                {
+                    SubDirs.push_back(AbsPath);
+                }
+                else if (Entry.is_regular_file())
+                {
+                    ScannedFileInfo Info;
+                    auto Temp = AbsPath.u8string();
+                    std::string_view Full(reinterpret_cast<const char*>(Temp.data()), Temp.size());
+                    size_t Slash = Full.find_last_of("/\\");
+                    std::string_view Dir = Full.substr(0, Slash == 0 ? 1 : Slash);
+                    if (LastDir.empty() || Dir != LastDir)
                     {
-                        ScannedFileInfo Info;
-                        auto Temp = AbsPath.u8string();
-                        Info.RelativePath = std::string(Temp.begin(), Temp.end());
-                        Info.Size = Entry.file_size();
-                        Info.MTime = ToTimeT(Entry.last_write_time());
-                        Files.push_back(std::move(Info));
+                        LastDir.assign(Dir);
+                        LastDirID = Paths.InternDirectory(Dir);
                     }
+                    Info.DirID = LastDirID;
+                    Info.Name = Paths.StoreName(Full.substr(Slash + 1));
+                    Info.Size = Entry.file_size();
+                    Info.MTime = ToTimeT(Entry.last_write_time());
+                    Out.push_back(std::move(Info));
                 }
-                catch (const FS::filesystem_error& e)
+            }
+            catch (const FS::filesystem_error& e)
+            {
+                std::cerr << "Filesystem error accessing entry: " << e.what() << " Path: " << Entry.path() << "\n";
+                Log.Error(std::string("Filesystem error accessing entry: ") + e.what() + std::string(" Path: ") + Entry.path().string());
+            }
+        }
+    }
+    catch (const FS::filesystem_error& e)
+    {
+        std::cerr << "Filesystem error iterating directory: " << e.what() << " Path: " << Current << "\n";
+        Log.Error(std::string("Filesystem error iterating directory: ") + e.what() + std::string(" Path: ") + Current.string());
+    }
+}
+
+#ifdef __linux__
+
+// Lists a directory with getdents64 into a per thread reusable buffer. d_type decides directories/symlinks without a stat,
+// regular files get a single statx relative to the directory fd for size + mtime. DT_UNKNOWN(some network/FUSE filesystems) falls back to statx for the type.
+// The statx calls for a whole directory are collected first so they can be submitted as one io_uring batch when IOUringScan is enabled.
+// With DirectorySkipIndex, a directory whose mtime matches the previous run reuses the remembered child list and skips getdents64 entirely.
+void FileScanner::ScanSingleDirectoryRaw(const FS::path& Current, std::vector<FS::path>& SubDirs, std::vector<ScannedFileInfo>& Out, DirectoryRecordList& DirsOut) const
+{
+    thread_local std::vector<char> DirentBuffer(DIRENT_BUFFER_SIZE);
+    thread_local std::vector<FS::path> PendingPaths;
+    thread_local std::vector<const char*> PendingNames;
+    thread_local std::vector<struct statx> StatxResults;
+    thread_local std::vector<int> StatxErrors;
+
+    int DirFd = open(Current.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (DirFd < 0)
+    {
+        std::cerr << "Filesystem error iterating directory: " << strerror(errno) << " Path: " << Current << "\n";
+        Log.Error(std::string("Filesystem error iterating directory: ") + strerror(errno) + std::string(" Path: ") + Current.string());
+        return;
+    }
+
+    std::vector<DirectoryChild>* Children = nullptr;
+    DirectoryRecord Fresh;
+
+    int64_t DirMTime = 0;
+    if (ConfigGlobal::DirectorySkipIndex)
+    {
+        struct statx DirStx;
+        if (statx(DirFd, "", AT_EMPTY_PATH, STATX_MTIME, &DirStx) == 0)
+        {
+            DirMTime = ToTimeT(DirStx.stx_mtime.tv_sec, DirStx.stx_mtime.tv_nsec);
+            auto It = PreviousDirRecords.find(Current.native());
+            if (It != PreviousDirRecords.end() && static_cast<int64_t>(It->second.MTime) == DirMTime)
+            {
+                Children = &It->second.Children;
+            }
+        }
+    }
+
+    if (!Children)
+    {
+        while (true)
+        {
+            long BytesRead = syscall(SYS_getdents64, DirFd, DirentBuffer.data(), DirentBuffer.size());
+            if (BytesRead < 0)
+            {
+                std::cerr << "Filesystem error iterating directory: " << strerror(errno) << " Path: " << Current << "\n";
+                Log.Error(std::string("Filesystem error iterating directory: ") + strerror(errno) + std::string(" Path: ") + Current.string());
+                DirMTime = 0; // Partial listing, never remember it
+                break;
+            }
+            if (BytesRead == 0)
+            {
+                break;
+            }
+
+            for (long Offset = 0; Offset < BytesRead; )
+            {
+                const LinuxDirent64* Dirent = reinterpret_cast<const LinuxDirent64*>(DirentBuffer.data() + Offset);
+                Offset += Dirent->d_reclen;
+
+                const char* Name = Dirent->d_name;
+                if (Name[0] == '.' && (Name[1] == '\0' || (Name[1] == '.' && Name[2] == '\0')))
                 {
-                    std::cerr << "Filesystem error accessing entry: " << e.what() << " Path: " << Entry.path() << "\n";
-                    Log.Error(std::string("Filesystem error accessing entry: ") + e.what() + std::string(" Path: ") + Entry.path().string());
+                    continue;
                 }
+                Fresh.Children.push_back({ Name, Dirent->d_type });
             }
         }
-        catch (const FS::filesystem_error& e)
+        Children = &Fresh.Children;
+    }
+
+    PendingPaths.clear();
+    for (const auto& Child : *Children)
+    {
+        FS::path AbsPath = Current / Child.Name;
+        unsigned char Type = Child.Type;
+
+        // Skip symbolic links to avoid loops or unsupported files.
+        if (Type == DT_LNK)
+        {
+            Log.Info(std::string("Skipping SymLink: ") + AbsPath.string());
+            continue;
+        }
+        if (Type != DT_DIR && Type != DT_REG && Type != DT_UNKNOWN)
         {
-            std::cerr << "Filesystem error iterating directory: " << e.what() << " Path: " << Current << "\n";
-            Log.Error(std::string("Filesystem error iterating directory: ") + e.what() + std::string(" Path: ") + Current.string());
+            continue;
+        }
+        if (IsExcluded(AbsPath, Type == DT_DIR))
+        {
+            std::cerr << "Skipping Excluded Path: " << AbsPath << "\n";
+            Log.Info(std::string("Skipping Excluded Path: ") + AbsPath.string());
+            continue;
+        }
+        if (Type == DT_DIR)
+        {
+            SubDirs.push_back(std::move(AbsPath));
+            continue;
+        }
+        PendingPaths.push_back(std::move(AbsPath));
+    }
+
+    // Directories modified within the last few seconds are not remembered, a change landing in the same timestamp tick
+    // after this listing would otherwise leave the mtime unchanged and hide the new entry on the next run(racy window)
+    constexpr int64_t RACY_WINDOW_NS = 2'000'000'000;
+    if (ConfigGlobal::DirectorySkipIndex && DirMTime != 0 && DirMTime < ScanStartTime - RACY_WINDOW_NS)
+    {
+        DirectoryRecord Record;
+        Record.MTime = static_cast<uint64_t>(DirMTime);
+        Record.Children = std::move(*Children);
+        DirsOut.emplace_back(Current.native(), std::move(Record));
+    }
+
+    // Names point into PendingPaths, which is not touched again until every statx below has completed
+    PendingNames.clear();
+    for (const auto& Path : PendingPaths)
+    {
+        const std::string& Native = Path.native();
+        PendingNames.push_back(Native.c_str() + Native.rfind('/') + 1);
+    }
+
+    uint32_t DirID = PendingNames.empty() ? 0 : Paths.InternDirectory(Current.native());
+
+    constexpr int StatxFlags = AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT;
+    constexpr unsigned StatxMask = STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_CTIME | STATX_INO;
+
+    bool Batched = false;
+    if (ConfigGlobal::IOUringScan && !PendingNames.empty())
+    {
+        if (IOUringStatx* Ring = GetThreadIOUring())
+        {
+            Batched = Ring->StatxBatch(DirFd, PendingNames, StatxFlags, StatxMask, StatxResults, StatxErrors);
+        }
+    }
+    if (!Batched)
+    {
+        StatxResults.resize(PendingNames.size());
+        StatxErrors.assign(PendingNames.size(), 0);
+    }
+    for (size_t i = 0; i < PendingNames.size(); ++i)
+    {
+        // Synchronous path, or single entries the kernel could not run through the ring(IORING_OP_STATX needs 5.6+)
+        if (!Batched || StatxErrors[i] == -EINVAL || StatxErrors[i] == -EOPNOTSUPP)
+        {
+            StatxErrors[i] = (statx(DirFd, PendingNames[i], StatxFlags, StatxMask, &StatxResults[i]) == 0) ? 0 : -errno;
+        }
+    }
+
+    for (size_t i = 0; i < PendingPaths.size(); ++i)
+    {
+        FS::path& AbsPath = PendingPaths[i];
+        const struct statx& Stx = StatxResults[i];
+        if (StatxErrors[i] != 0)
+        {
+            std::cerr << "Filesystem error accessing entry: " << strerror(-StatxErrors[i]) << " Path: " << AbsPath << "\n";
+            Log.Error(std::string("Filesystem error accessing entry: ") + strerror(-StatxErrors[i]) + std::string(" Path: ") + AbsPath.string());
+            continue;
+        }
+
+        if (S_ISLNK(Stx.stx_mode))
+        {
+            Log.Info(std::string("Skipping SymLink: ") + AbsPath.string());
+        }
+        else if (S_ISDIR(Stx.stx_mode))
+        {
+            SubDirs.push_back(std::move(AbsPath));
+        }
+        else if (S_ISREG(Stx.stx_mode))
+        {
+            ScannedFileInfo Info;
+            Info.DirID = DirID;
+            Info.Name = Paths.StoreName(PendingNames[i]);
+            Info.Size = Stx.stx_size;
+            Info.MTime = ToTimeT(Stx.stx_mtime.tv_sec, Stx.stx_mtime.tv_nsec);
+            Info.CTime = ToTimeT(Stx.stx_ctime.tv_sec, Stx.stx_ctime.tv_nsec);
+            Info.Inode = Stx.stx_ino;
+            Out.push_back(std::move(Info));
         }
     }
-}
\ No newline at end of file
+    close(DirFd);
+}
+
+// Lazily creates the io_uring for the calling thread, returns nullptr(synchronous statx) if io_uring is unavailable on this system
+IOUringStatx* FileScanner::GetThreadIOUring()
+{
+    static std::atomic<bool> IOUringUnavailable = false;
+    thread_local std::unique_ptr<IOUringStatx> Ring;
+
+    if (IOUringUnavailable.load(std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+    if (!Ring)
+    {
+        Ring = std::make_unique<IOUringStatx>(ConfigGlobal::IOUringQueueDepth);
+        if (!Ring->IsValid())
+        {
+            Ring.reset();
+            if (!IOUringUnavailable.exchange(true))
+            {
+                Log.Info(std::string("[File Scanner] io_uring unavailable, falling back to synchronous statx"));
+            }
+            return nullptr;
+        }
+    }
+    return Ring.get();
+}
+
+#endif
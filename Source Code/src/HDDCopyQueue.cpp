@@ -1,6 +1,9 @@
 #include "HDDCopyQueue.hpp"
 #include "ConfigGlobal.hpp"
 #include "FileCopier.hpp"
+#include "SourceIndex.hpp"
+#include "CopyState.hpp"
+#include "CacheStore.hpp"
 #include <filesystem>
 #include <iostream>
 
@@ -15,11 +18,6 @@ HDDCopyQueue::~HDDCopyQueue()
 
 void HDDCopyQueue::Start()
 {
-    if (!HDDCopyStateCache.LoadCopiedState())
-    {
-        std::cerr << "[ERROR] Failed to load state file for copy tracking.\n";
-        Log.Error(std::string("[HDDCopyQueue - CopyStateCache] Failed to Load State File for Copy Tracking."));
-    }
     HDDRunning = true;
     HDDCopyThread = std::thread(&HDDCopyQueue::CopyThreadLoop, this);
 }
@@ -36,6 +34,7 @@ void HDDCopyQueue::Stop()
     {
         HDDCopyThread.join();
     }
+    Journal.Flush();
 }
 
 void HDDCopyQueue::IncrementPendingSources()
@@ -65,16 +64,18 @@ void HDDCopyQueue::WaitUntilDone()
     HDD_CV.wait(lock, [this]() {return HDDPendingSources == 0 && HDDGlobalCopyQueue.empty() && HDDAllSourcesSubmitted; });
 }
 
-void HDDCopyQueue::SubmitCopyQueue(uint32_t BinID, std::queue<FileInfo>&& queue, std::vector<FileInfo>&& freshFiles)
+void HDDCopyQueue::SubmitCopyQueue(uint32_t BinID, std::queue<FileInfo>&& queue, bool finalBatch, std::shared_ptr<MetaDataCache> sourceCache)
 {
     Log.Info(std::string("[HDDCopyQueue] Received Queue for Source BinID = ") + std::to_string(BinID) +
-        std::string(" | Files: ") + std::to_string(queue.size()));
+        std::string(" | Files: ") + std::to_string(queue.size()) + (finalBatch ? std::string(" | Final Batch") : std::string()));
 
     {
         std::lock_guard<std::mutex> lock(HDDCQ_Mutex);
         CopyTask task;
         task.FileQueue = std::move(queue);
-        task.FreshFiles = std::move(freshFiles);
+        task.SourceRoot = SourceIndex::PathOf(BinID);
+        task.FinalBatch = finalBatch;
+        task.SourceCache = std::move(sourceCache);
         HDDGlobalCopyQueue.emplace(BinID, std::move(task));
     }
     HDD_CV.notify_one();
@@ -98,45 +99,62 @@ void HDDCopyQueue::CopyThreadLoop()
 
         auto [BinID, task] = std::move(HDDGlobalCopyQueue.front());
         std::queue<FileInfo>& FileQueue = task.FileQueue;
-        std::vector<FileInfo>& FreshFiles = task.FreshFiles;
         HDDGlobalCopyQueue.pop();
         lock.unlock();
 
-        std::unordered_set<std::string> SuccessSet;
+        size_t CopiedCount = 0;
         size_t OriginalFileCount = FileQueue.size();
+        bool FinalBatch = task.FinalBatch;
 
         while (!FileQueue.empty())
         {
             FileInfo file = std::move(FileQueue.front());
             FileQueue.pop();
 
-            std::string SourceTopRootPath = HDDCopyStateCache.GetPathFromSourceID(BinID);
-            if (FileCopier::PerformFileCopy(file.AbsolutePath, SourceTopRootPath))
+            if (FileCopier::PerformFileCopy(file.AbsolutePath, task.SourceRoot))
             {
-                SuccessSet.insert(file.AbsolutePath);
+                ++CopiedCount;
+                Journal.Record(BinID, file);
+                if (task.SourceCache)
+                {
+                    task.SourceCache->UpdateEntry(std::move(file)); // Saved only once the whole source copied without a failure
+                }
             }
             else
             {
                 Log.Error(std::string("[HDDCopyQueue] Copy failed for ") + file.AbsolutePath);
             }
         }
-        if (SuccessSet.size() != OriginalFileCount)
+        size_t FailedCount = HDDFailedPerSource[BinID] + (OriginalFileCount - CopiedCount);
+        if (!FinalBatch)
+        {
+            HDDFailedPerSource[BinID] = FailedCount;
+            continue; // More batches for this source to come
+        }
+        HDDFailedPerSource.erase(BinID);
+
+        if (FailedCount != 0)
         {
             Log.Error(std::string("[HDDCopyQueue] Not all files copied for BinID: ") + std::to_string(BinID));
+            Journal.Flush(); // Keep the completions so the next run only copies what is missing
             DecrementPendingSources();
             continue; // Skip marking as copied
         }
-        HDDCopyStateCache.MarkCopied(BinID); // Mark as fully copied
         Log.Info(std::string("[HDDCopyQueue] All files Copied for BinID: ") + std::to_string(BinID));
-        for (const auto& fileInfo : FreshFiles)
-        {
-            HDDCopyStateCache.UpdateEntry(fileInfo.AbsolutePath, fileInfo);
-        }
-        HDDCopyStateCache.RemoveStaleEntries(ConfigGlobal::StaleEntries);
-        if (!HDDCopyStateCache.Save(BinID))
+        std::shared_ptr<MetaDataCache> SourceCachePtr = task.SourceCache ? task.SourceCache : std::make_shared<MetaDataCache>();
+        // Saved in the background, the copy thread moves on to the next source
+        CacheStore::Save(std::move(SourceCachePtr), BinID, [this, BinID](bool saved)
         {
-            Log.Error(std::string("[UpdateCacheForSource] Failed to Save Cache File Bin ID: ") + std::to_string(BinID));
-        }
+            if (!saved)
+            {
+                Journal.Flush();
+            }
+            else
+            {
+                Journal.Discard(BinID); // Everything it recorded is in the saved cache now
+            }
+            CopyState::MarkCopied(BinID); // Mark as fully copied
+        });
         DecrementPendingSources();
     }
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#ifdef __linux__
+
+#include "IOUringStatx.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+IOUringStatx::IOUringStatx(unsigned QueueDepth)
+{
+    io_uring_params Params;
+    std::memset(&Params, 0, sizeof(Params));
+
+    int Fd = static_cast<int>(syscall(__NR_io_uring_setup, QueueDepth, &Params));
+    if (Fd < 0)
+    {
+        return; // ENOSYS on old kernels, EPERM when disabled by sysctl/seccomp
+    }
+
+    SQRingSize = Params.sq_off.array + Params.sq_entries * sizeof(unsigned);
+    CQRingSize = Params.cq_off.cqes + Params.cq_entries * sizeof(io_uring_cqe);
+    bool SingleMmap = (Params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (SingleMmap)
+    {
+        SQRingSize = CQRingSize = std::max(SQRingSize, CQRingSize);
+    }
+
+    SQRingPtr = mmap(nullptr, SQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQ_RING);
+    if (SQRingPtr == MAP_FAILED)
+    {
+        SQRingPtr = nullptr;
+        close(Fd);
+        return;
+    }
+
+    if (SingleMmap)
+    {
+        CQRingPtr = SQRingPtr;
+    }
+    else
+    {
+        CQRingPtr = mmap(nullptr, CQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_CQ_RING);
+        if (CQRingPtr == MAP_FAILED)
+        {
+            CQRingPtr = nullptr;
+            munmap(SQRingPtr, SQRingSize);
+            SQRingPtr = nullptr;
+            close(Fd);
+            return;
+        }
+    }
+
+    SQEsSize = Params.sq_entries * sizeof(io_uring_sqe);
+    void* SQEsPtr = mmap(nullptr, SQEsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQES);
+    if (SQEsPtr == MAP_FAILED)
+    {
+        if (CQRingPtr != SQRingPtr)
+        {
+            munmap(CQRingPtr, CQRingSize);
+        }
+        munmap(SQRingPtr, SQRingSize);
+        SQRingPtr = CQRingPtr = nullptr;
+        close(Fd);
+        return;
+    }
+    SQEs = static_cast<io_uring_sqe*>(SQEsPtr);
+
+    char* SQBase = static_cast<char*>(SQRingPtr);
+    SQTail = reinterpret_cast<unsigned*>(SQBase + Params.sq_off.tail);
+    SQMask = reinterpret_cast<unsigned*>(SQBase + Params.sq_off.ring_mask);
+    SQArray = reinterpret_cast<unsigned*>(SQBase + Params.sq_off.array);
+
+    char* CQBase = static_cast<char*>(CQRingPtr);
+    CQHead = reinterpret_cast<unsigned*>(CQBase + Params.cq_off.head);
+    CQTail = reinterpret_cast<unsigned*>(CQBase + Params.cq_off.tail);
+    CQMask = reinterpret_cast<unsigned*>(CQBase + Params.cq_off.ring_mask);
+    CQEs = reinterpret_cast<io_uring_cqe*>(CQBase + Params.cq_off.cqes);
+
+    SQEntries = Params.sq_entries;
+    RingFd = Fd;
+}
+
+IOUringStatx::~IOUringStatx()
+{
+    Close();
+}
+
+void IOUringStatx::Close()
+{
+    if (SQEs)
+    {
+        munmap(SQEs, SQEsSize);
+    }
+    if (CQRingPtr && CQRingPtr != SQRingPtr)
+    {
+        munmap(CQRingPtr, CQRingSize);
+    }
+    if (SQRingPtr)
+    {
+        munmap(SQRingPtr, SQRingSize);
+    }
+    if (RingFd >= 0)
+    {
+        close(RingFd);
+    }
+    SQEs = nullptr;
+    SQRingPtr = CQRingPtr = nullptr;
+    RingFd = -1;
+}
+
+// Waits for every submitted but unreaped statx of a failed batch, their completions must not leak into the next batch and they must not
+// write into Results after the caller reuses it. The ring is closed afterwards either way, the SQEs it never consumed would otherwise be
+// submitted with the next batch
+void IOUringStatx::DrainAndClose(unsigned InFlight)
+{
+    while (InFlight > 0)
+    {
+        if (Enter(0, 1) < 0)
+        {
+            break; // Closing the ring cancels what is left
+        }
+        unsigned Head = *CQHead;
+        unsigned CTail = __atomic_load_n(CQTail, __ATOMIC_ACQUIRE);
+        while (Head != CTail && InFlight > 0)
+        {
+            ++Head;
+            --InFlight;
+        }
+        __atomic_store_n(CQHead, Head, __ATOMIC_RELEASE);
+    }
+    Close();
+}
+
+bool IOUringStatx::IsValid() const
+{
+    return RingFd >= 0;
+}
+
+int IOUringStatx::Enter(unsigned ToSubmit, unsigned MinComplete)
+{
+    while (true)
+    {
+        int Ret = static_cast<int>(syscall(__NR_io_uring_enter, RingFd, ToSubmit, MinComplete, MinComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+        if (Ret >= 0 || errno != EINTR)
+        {
+            return Ret;
+        }
+    }
+}
+
+bool IOUringStatx::StatxBatch(int DirFd, const std::vector<const char*>& Names, int Flags, unsigned Mask, std::vector<struct statx>& Results, std::vector<int>& Errors)
+{
+    if (!IsValid())
+    {
+        return false;
+    }
+
+    Results.resize(Names.size());
+    Errors.assign(Names.size(), 0);
+
+    // Submit in chunks of the ring size, every chunk is fully reaped before the next one so the CQ can never overflow
+    for (size_t Start = 0; Start < Names.size(); Start += SQEntries)
+    {
+        unsigned Count = static_cast<unsigned>(std::min<size_t>(SQEntries, Names.size() - Start));
+
+        unsigned Tail = *SQTail;
+        for (unsigned i = 0; i < Count; ++i)
+        {
+            size_t Index = Start + i;
+            unsigned Slot = Tail & *SQMask;
+            io_uring_sqe* Sqe = &SQEs[Slot];
+            std::memset(Sqe, 0, sizeof(*Sqe));
+            Sqe->opcode = IORING_OP_STATX;
+            Sqe->fd = DirFd;
+            Sqe->addr = reinterpret_cast<uint64_t>(Names[Index]);
+            Sqe->len = Mask;
+            Sqe->off = reinterpret_cast<uint64_t>(&Results[Index]);
+            Sqe->statx_flags = static_cast<uint32_t>(Flags);
+            Sqe->user_data = Index;
+            SQArray[Slot] = Slot;
+            ++Tail;
+        }
+        __atomic_store_n(SQTail, Tail, __ATOMIC_RELEASE);
+
+        unsigned Submitted = 0;
+        unsigned Reaped = 0;
+        while (Reaped < Count)
+        {
+            unsigned ToSubmit = Count - Submitted;
+            int Ret = Enter(ToSubmit, 1);
+            if (Ret < 0)
+            {
+                DrainAndClose(Submitted - Reaped);
+                return false;
+            }
+            Submitted += std::min<unsigned>(static_cast<unsigned>(Ret), ToSubmit);
+
+            unsigned Head = *CQHead;
+            unsigned CTail = __atomic_load_n(CQTail, __ATOMIC_ACQUIRE);
+            while (Head != CTail)
+            {
+                const io_uring_cqe* Cqe = &CQEs[Head & *CQMask];
+                Errors[Cqe->user_data] = Cqe->res;
+                ++Head;
+                ++Reaped;
+            }
+            __atomic_store_n(CQHead, Head, __ATOMIC_RELEASE);
+        }
+    }
+    return true;
+}
+
+#endif
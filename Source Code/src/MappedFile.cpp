@@ -0,0 +1,136 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <filesystem>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string& FilePath)
+{
+    Close();
+
+    std::wstring WidePath = std::filesystem::path(FilePath).wstring();
+    HANDLE File = CreateFileW(WidePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER FileSize;
+    if (!GetFileSizeEx(File, &FileSize) || FileSize.QuadPart == 0)
+    {
+        CloseHandle(File);
+        return false;
+    }
+
+    HANDLE Mapping = CreateFileMappingW(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!Mapping)
+    {
+        CloseHandle(File);
+        return false;
+    }
+
+    void* View = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!View)
+    {
+        CloseHandle(Mapping);
+        CloseHandle(File);
+        return false;
+    }
+
+    FileHandle = File;
+    MappingHandle = Mapping;
+    MappedData = static_cast<const uint8_t*>(View);
+    MappedSize = static_cast<size_t>(FileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (MappedData)
+    {
+        UnmapViewOfFile(MappedData);
+    }
+    if (MappingHandle)
+    {
+        CloseHandle(MappingHandle);
+    }
+    if (FileHandle)
+    {
+        CloseHandle(FileHandle);
+    }
+    MappedData = nullptr;
+    MappedSize = 0;
+    MappingHandle = nullptr;
+    FileHandle = nullptr;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& FilePath)
+{
+    Close();
+
+    int Fd = open(FilePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (Fd < 0)
+    {
+        return false;
+    }
+
+    struct stat St;
+    if (fstat(Fd, &St) != 0 || St.st_size <= 0)
+    {
+        close(Fd);
+        return false;
+    }
+
+    void* View = mmap(nullptr, static_cast<size_t>(St.st_size), PROT_READ, MAP_PRIVATE, Fd, 0);
+    close(Fd); // The mapping keeps its own reference to the file
+    if (View == MAP_FAILED)
+    {
+        return false;
+    }
+
+    MappedData = static_cast<const uint8_t*>(View);
+    MappedSize = static_cast<size_t>(St.st_size);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (MappedData)
+    {
+        munmap(const_cast<uint8_t*>(MappedData), MappedSize);
+    }
+    MappedData = nullptr;
+    MappedSize = 0;
+}
+
+#endif
+
+bool MappedFile::IsOpen() const
+{
+    return MappedData != nullptr;
+}
+
+const uint8_t* MappedFile::Data() const
+{
+    return MappedData;
+}
+
+size_t MappedFile::Size() const
+{
+    return MappedSize;
+}
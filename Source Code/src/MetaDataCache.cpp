@@ -7,22 +7,114 @@
 #include <fstream>
 #include <iostream>
 #include <cstring>
+#include <thread>
+#include <iterator>
+#include "BoundedQueue.hpp"
+#include "TimeUtils.hpp"
+#include "Blake3/blake3.h"
+#include "AtomicFile.hpp"
+#include "CopyJournal.hpp"
+#include "SourceIndex.hpp"
+#include "CacheStore.hpp"
+#include <sstream>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
 
 namespace FS = std::filesystem;
-std::mutex IndexMutex;
+
+constexpr size_t PIPELINE_BATCH_SIZE = 4096; // Scanned files per batch handed from the scanner to hash/diff
+constexpr size_t PIPELINE_QUEUE_DEPTH = 8; // Batches buffered between scanner and hash/diff before the scanner blocks
+
+constexpr uint32_t CACHE_FILE_VERSION_HYBRID = 1; // Stream format with header, written before the mapped format
+constexpr uint8_t BASE_VISITED = 0x01;
+constexpr uint8_t BASE_OVERRIDDEN = 0x02; // Newer copy of the entry lives in Entries
+constexpr uint8_t BASE_REMOVED = 0x04; // Dropped by RemoveStaleEntries
 
 template<typename T>
-bool ReadBinary(std::ifstream& stream, T& value)
+bool ReadBinary(std::istream& stream, T& value)
 {
     return static_cast<bool>(stream.read(reinterpret_cast<char*>(&value), sizeof(T)));
 }
 
 template<typename T>
-bool WriteBinary(std::ofstream& stream, const T& value)
+bool WriteBinary(std::ostream& stream, const T& value)
 {
     return static_cast<bool>(stream.write(reinterpret_cast<const char*>(&value), sizeof(T)));
 }
 
+static void AppendVarint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static uint64_t ReadVarint(const uint8_t*& cursor)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        uint8_t byte = *cursor++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            break;
+        }
+    }
+    return value;
+}
+
+// Turns path, holding the previous entry's path, into the path of the front coded entry at cursor
+static void DecodeFrontCoded(const uint8_t* cursor, std::string& path)
+{
+    uint64_t shared = ReadVarint(cursor);
+    uint64_t suffixLen = ReadVarint(cursor);
+    path.resize(std::min<size_t>(static_cast<size_t>(shared), path.size()));
+    path.append(reinterpret_cast<const char*>(cursor), static_cast<size_t>(suffixLen));
+}
+
+// Full path of a restart point, read in place
+static std::string_view RestartPath(const uint8_t* cursor)
+{
+    ReadVarint(cursor); // Shared prefix, always 0 at a restart point
+    uint64_t suffixLen = ReadVarint(cursor);
+    return std::string_view(reinterpret_cast<const char*>(cursor), static_cast<size_t>(suffixLen));
+}
+
+static CacheRecord ToCacheRecord(const FileInfo& info)
+{
+    CacheRecord record{};
+    record.Size = info.Size;
+    record.MTime = info.MTime;
+    record.CTime = info.CTime;
+    record.Inode = info.Inode;
+    record.Hash = info.Hash;
+    record.MissCount = info.MissCount;
+    record.Flags = info.ContentHashed ? CACHE_RECORD_CONTENT_HASHED : 0;
+    return record;
+}
+
+static bool SameRecord(const CacheRecord& record, const FileInfo& info)
+{
+    return record.Size == info.Size && record.MTime == info.MTime && record.CTime == info.CTime && record.Inode == info.Inode &&
+        record.Hash == info.Hash && ((record.Flags & CACHE_RECORD_CONTENT_HASHED) != 0) == info.ContentHashed;
+}
+
+// Everything but the path, overlay keys view it
+static void AssignAttributes(FileInfo& entry, const FileInfo& info)
+{
+    entry.Size = info.Size;
+    entry.MTime = info.MTime;
+    entry.Hash = info.Hash;
+    entry.CTime = info.CTime;
+    entry.Inode = info.Inode;
+    entry.ContentHashed = info.ContentHashed;
+}
+
 MetaDataCache::MetaDataCache(const std::string& cacheFilePath) : CacheFilePath(cacheFilePath)
 {
     EnsureCacheDirExists();
@@ -45,14 +137,26 @@ void MetaDataCache::EnsureCacheDirExists()
     }
 }
 
-// Loads cache entries from the binary file into memory
+// Maps the cache bin, older formats are read into memory and rewritten as version 2 on the next save
 bool MetaDataCache::Load(uint32_t MetaDataCacheBinFileNumber)
 {
-    std::lock_guard lock(MetaCacheMutex);
-    Entries.clear();
+    std::unique_lock lock(MetaCacheMutex);
+    return LoadLocked(MetaDataCacheBinFileNumber);
+}
+
+bool MetaDataCache::LoadLocked(uint32_t MetaDataCacheBinFileNumber)
+{
+    for (auto& shard : Shards)
+    {
+        shard.Entries.clear();
+    }
+    CloseBase();
+    LastScanTime = 0;
+    StaleResolved = false;
+
     std::string MetaCacheLoadFilePath = (ConfigGlobal::DestinationCacheDir / (std::to_string(MetaDataCacheBinFileNumber) + ".bin")).string();
-    std::ifstream file(MetaCacheLoadFilePath, std::ios::binary);
-    if (!file)
+    std::error_code ec;
+    if (!FS::exists(MetaCacheLoadFilePath, ec))
     {
         Log.Info(std::string("[MetaDataCache::Load] Starting Fresh. No Cache File Found at: ") + MetaCacheLoadFilePath);
         // File missing is OK, just start fresh
@@ -61,10 +165,92 @@ bool MetaDataCache::Load(uint32_t MetaDataCacheBinFileNumber)
 
     Log.Info(std::string("[MetaDataCache::Load] Loading from: ") + MetaCacheLoadFilePath);
 
+    if (BaseFile.Open(MetaCacheLoadFilePath) && BaseFile.Size() >= sizeof(CacheFileHeader))
+    {
+        CacheFileHeader header;
+        std::memcpy(&header, BaseFile.Data(), sizeof(header));
+        if (header.Magic == CACHE_FILE_MAGIC && header.Version == CACHE_FILE_VERSION)
+        {
+            return LoadMapped(MetaCacheLoadFilePath);
+        }
+    }
+    BaseFile.Close();
+    return LoadStream(MetaCacheLoadFilePath);
+}
+
+bool MetaDataCache::LoadMapped(const std::string& FilePath)
+{
+    const uint8_t* data = BaseFile.Data();
+    size_t size = BaseFile.Size();
+    CacheFileHeader header;
+    std::memcpy(&header, data, sizeof(header));
+
+    size_t payloadSize = size - sizeof(header);
+    if (header.RecordSize != sizeof(CacheRecord) || header.RestartInterval != CACHE_RESTART_INTERVAL ||
+        header.EntryCount > payloadSize / sizeof(CacheRecord) ||
+        header.BlobSize != payloadSize - header.EntryCount * sizeof(CacheRecord))
+    {
+        Log.Error(std::string("[MetaDataCache::Load]: Invalid Cache File Layout: ") + FilePath);
+        CloseBase();
+        return false;
+    }
+
+    std::array<uint8_t, 16> checksum{};
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, data + sizeof(header), payloadSize);
+    blake3_hasher_finalize(&hasher, checksum.data(), checksum.size());
+    if (checksum != header.Checksum)
+    {
+        Log.Error(std::string("[MetaDataCache::Load]: Cache File Checksum Mismatch: ") + FilePath);
+        CloseBase();
+        return false;
+    }
+
+    BaseCount = static_cast<size_t>(header.EntryCount);
+    BaseRecords = reinterpret_cast<const CacheRecord*>(data + sizeof(header));
+    BaseBlob = data + sizeof(header) + BaseCount * sizeof(CacheRecord);
+    BaseState = std::vector<std::atomic<uint8_t>>(BaseCount);
+    LastScanTime = header.LastScanTime;
+
+    Log.Info(std::string("[MetaDataCache::Load] Finished Mapping ") + std::to_string(BaseCount) + std::string(" entries."));
+    return true;
+}
+
+// Version 1 and headerless bins, every entry is parsed into Entries
+bool MetaDataCache::LoadStream(const std::string& FilePath)
+{
+    std::ifstream file(FilePath, std::ios::binary);
+    if (!file)
+    {
+        Log.Info(std::string("[MetaDataCache::Load] Starting Fresh. Cache File Not Readable: ") + FilePath);
+        return true;
+    }
+
+    uint32_t firstWord = 0;
+    bool haveFirstWord = ReadBinary(file, firstWord);
+    bool versioned = haveFirstWord && firstWord == CACHE_FILE_MAGIC;
+    if (versioned)
+    {
+        uint32_t version = 0;
+        if (!ReadBinary(file, version) || version != CACHE_FILE_VERSION_HYBRID)
+        {
+            Log.Info(std::string("[MetaDataCache::Load]: Unsupported Cache File Version"));
+            return false;
+        }
+        if (!ReadBinary(file, LastScanTime)) return false;
+        haveFirstWord = false;
+    }
+
     while (file)
     {
         uint32_t pathLen = 0;
-        if (!ReadBinary(file, pathLen)) break;
+        if (haveFirstWord)
+        {
+            pathLen = firstWord; // Headerless format, the first word was already the first path length
+            haveFirstWord = false;
+        }
+        else if (!ReadBinary(file, pathLen)) break;
         if (pathLen == 0 || pathLen > 4096) // sanity check max path length
         {
             Log.Info(std::string("[MetaDataCache::Load]: Invalid Path Length in Cache"));
@@ -86,282 +272,638 @@ bool MetaDataCache::Load(uint32_t MetaDataCacheBinFileNumber)
         if (!file.read(reinterpret_cast<char*>(info.Hash.data()), info.Hash.size())) return false;
         if (!ReadBinary(file, info.Visited)) return false;
         if (!ReadBinary(file, info.MissCount)) return false;
-
-        /*std::cout << "[MetaDataCache::Load] Loaded entry:\n";
-        std::cout << "  Path: " << info.AbsolutePath << "\n";
-        std::cout << "  Size: " << info.Size << "\n";
-        std::cout << "  MTime: " << info.MTime << "\n";
-        std::cout << "  Hash: ";
-        for (unsigned char byte : info.Hash)
+        if (versioned)
         {
-            printf("%02X", byte);
+            if (!ReadBinary(file, info.CTime)) return false;
+            if (!ReadBinary(file, info.Inode)) return false;
+            if (!ReadBinary(file, info.ContentHashed)) return false;
         }
-        std::cout << "\n";*/
 
-        Entries.emplace(info.AbsolutePath, std::move(info));
+        InsertEntry(ShardOf(info.AbsolutePath), std::move(info));
     }
-    Log.Info(std::string("[MetaDataCache::Load] Finished Loading ") + std::to_string(Entries.size()) + std::string(" entries."));
+    Log.Info(std::string("[MetaDataCache::Load] Finished Loading ") + std::to_string(EntryCount()) + std::string(" entries."));
     return true;
 }
 
-// Serializes and writes all in-memory cache entries to the binary file
-bool MetaDataCache::Save(uint32_t MetaDataCacheBinFileNumber)
+void MetaDataCache::CloseBase()
 {
-    std::lock_guard lock(MetaCacheMutex);
-    std::string MetaCacheSaveFilePath = (ConfigGlobal::DestinationCacheDir / (std::to_string(MetaDataCacheBinFileNumber) + ".bin")).string();
-    std::ofstream file(MetaCacheSaveFilePath, std::ios::binary | std::ios::trunc);
-    if (!file)
-    {
-        Log.Error(std::string("[MetadataCache::Save]: Failed to Open Cache File for Writing: ") + MetaCacheSaveFilePath);
-        return false;
-    }
-
-    for (const auto& [path, info] : Entries)
-    {
-        uint32_t pathLen = static_cast<uint32_t>(path.size());
-        if (!WriteBinary(file, pathLen)) return false;
-        if (!file.write(path.data(), pathLen)) return false;
-        if (!WriteBinary(file, info.Size)) return false;
-        if (!WriteBinary(file, info.MTime)) return false;
-        if (!file.write(reinterpret_cast<const char*>(info.Hash.data()), info.Hash.size())) return false;
-        if (!WriteBinary(file, info.Visited)) return false;
-        if (!WriteBinary(file, info.MissCount)) return false;
-    }
-    file.flush();
-    Log.Info(std::string("[MetaDataCache::Save] Successfully Saved Cache Entries: ") + MetaCacheSaveFilePath);
-    return true;
+    BaseFile.Close();
+    BaseRecords = nullptr;
+    BaseBlob = nullptr;
+    BaseCount = 0;
+    BaseState.clear();
+    BaseMissCount.clear();
 }
 
-bool MetaDataCache::HasEntry(const std::string& path) const
+MetaDataCache::EntryShard& MetaDataCache::ShardOf(std::string_view path) const
 {
-    std::lock_guard lock(MetaCacheMutex);
-    return Entries.find(path) != Entries.end();
+    return Shards[std::hash<std::string_view>{}(path) % ENTRY_SHARD_COUNT];
 }
 
-FileInfo MetaDataCache::GetEntry(const std::string& path) const
+// The node is created under a placeholder key, then re-keyed with a view of the path it now owns. Node handles move between
+// extract and insert without reallocating, so the view stays valid for as long as the entry is in the map
+void MetaDataCache::InsertEntry(EntryShard& shard, FileInfo&& info)
 {
-    std::lock_guard lock(MetaCacheMutex);
-    auto it = Entries.find(path);
-    return (it != Entries.end()) ? it->second : FileInfo{};
+    auto placed = shard.Entries.try_emplace(std::string_view(), std::move(info)).first;
+    auto node = shard.Entries.extract(placed);
+    node.key() = node.mapped().AbsolutePath;
+    shard.Entries.insert(std::move(node));
 }
 
-void MetaDataCache::MarkVisited(const std::string& path)
+size_t MetaDataCache::EntryCount() const
 {
-    std::lock_guard lock(MetaCacheMutex);
-    /*std::cout << "[MarkVisited] Looking for: " << path << "\n";
-    Log.Info(std::string("[MarkVisited] Marked as visited: ") + path);
-    std::cout << "[MarkVisisted] Current cache keys:\n";
-    for (const auto& [k, v] : Entries)
-    {
-        std::cout << "  -> " << k << "\n";
-    }*/
-    auto it = Entries.find(path);
-    if (it != Entries.end())
+    size_t count = 0;
+    for (const auto& shard : Shards)
     {
-        it->second.Visited = true;
-        it->second.MissCount = 0;
+        count += shard.Entries.size();
     }
+    return count;
 }
 
-void MetaDataCache::UpdateEntry(const std::string& path, const FileInfo& info)
+// Binary search over the restart points, then a forward decode of at most one restart interval
+size_t MetaDataCache::FindBase(std::string_view path) const
 {
-    std::lock_guard lock(MetaCacheMutex);
+    if (BaseCount == 0)
+    {
+        return SIZE_MAX;
+    }
 
-    /*std::cout << "[UpdateEntry] Looking for: " << path << "\n";
-    Log.Info(std::string("[UpdateEntry] Updated cache entry: ") + path);
-    std::cout << "[UpdateEntry] Current cache keys:\n";
-    for (const auto& [k, v] : Entries)
+    size_t low = 0;
+    size_t high = (BaseCount + CACHE_RESTART_INTERVAL - 1) / CACHE_RESTART_INTERVAL;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (RestartPath(BaseBlob + BaseRecords[mid * CACHE_RESTART_INTERVAL].PathOffset) <= path)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    if (low == 0)
     {
-        std::cout << "  -> " << v.Copied << "\n";
-    }*/
+        return SIZE_MAX;
+    }
 
-    auto it = Entries.find(path);
-    if (it != Entries.end())
+    size_t first = (low - 1) * CACHE_RESTART_INTERVAL;
+    size_t last = std::min<size_t>(BaseCount, first + CACHE_RESTART_INTERVAL);
+    thread_local std::string lookupPath; // Decode buffer, lookups run concurrently under the shared lock
+    lookupPath.clear();
+    for (size_t i = first; i < last; ++i)
     {
-        it->second = info;
-        it->second.Visited = true;
-        it->second.MissCount = 0;
+        DecodeFrontCoded(BaseBlob + BaseRecords[i].PathOffset, lookupPath);
+        int order = lookupPath.compare(path);
+        if (order == 0)
+        {
+            return i;
+        }
+        if (order > 0)
+        {
+            break;
+        }
     }
-    else
+    return SIZE_MAX;
+}
+
+void MetaDataCache::DecodeBasePath(size_t index, std::string& path) const
+{
+    path.clear();
+    for (size_t i = index - index % CACHE_RESTART_INTERVAL; i <= index; ++i)
     {
-        // Insert new entry
-        FileInfo newInfo = info;
-        newInfo.Visited = true;
-        newInfo.MissCount = 0;
-        Entries.emplace(path, std::move(newInfo));
+        DecodeFrontCoded(BaseBlob + BaseRecords[i].PathOffset, path);
     }
 }
 
-void MetaDataCache::RemoveStaleEntries(int maxMissCount)
+FileInfo MetaDataCache::BaseEntry(size_t index, std::string path) const
 {
-    std::lock_guard lock(MetaCacheMutex);
-    for (auto it = Entries.begin(); it != Entries.end(); )
+    const CacheRecord& record = BaseRecords[index];
+    FileInfo info;
+    info.AbsolutePath = std::move(path);
+    info.Size = record.Size;
+    info.MTime = record.MTime;
+    info.Hash = record.Hash;
+    info.CTime = record.CTime;
+    info.Inode = record.Inode;
+    info.ContentHashed = (record.Flags & CACHE_RECORD_CONTENT_HASHED) != 0;
+    info.Visited = (BaseState[index] & BASE_VISITED) != 0;
+    info.MissCount = info.Visited ? 0 : (BaseMissCount.empty() ? record.MissCount : BaseMissCount[index]);
+    return info;
+}
+
+// Merges the mapped entries with the in-memory ones into a sorted version 2 bin, written atomically over the live one.
+// The new bin is mapped again afterwards so the cache stays usable.
+bool MetaDataCache::Save(uint32_t MetaDataCacheBinFileNumber)
+{
+    std::unique_lock lock(MetaCacheMutex);
+    std::string MetaCacheSaveFilePath = (ConfigGlobal::DestinationCacheDir / (std::to_string(MetaDataCacheBinFileNumber) + ".bin")).string();
+
+    std::vector<const EntryMap::value_type*> added;
+    added.reserve(EntryCount());
+    for (const auto& shard : Shards)
     {
-        if (!it->second.Visited)
+        for (const auto& entry : shard.Entries)
         {
-            it->second.MissCount++;
-            if (it->second.MissCount > maxMissCount)
+            added.push_back(&entry);
+        }
+    }
+    std::sort(added.begin(), added.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+
+    std::vector<CacheRecord> records;
+    records.reserve(BaseCount + added.size());
+    std::string blob;
+    std::string previous;
+    auto append = [&](std::string_view path, CacheRecord record)
+    {
+        size_t shared = 0;
+        if (records.size() % CACHE_RESTART_INTERVAL != 0)
+        {
+            size_t limit = std::min(previous.size(), path.size());
+            while (shared < limit && previous[shared] == path[shared])
             {
-                if (ConfigGlobal::DeleteStaleFromDest)
-                {
-                    FileCopier::DeleteStaleFromDestination(it->first);
-                }
-                Log.Info(std::string("[RemoveStaleEntries] Deleted Stale Entry: ") + it->first);
-                it = Entries.erase(it);
-                continue;
+                ++shared;
             }
         }
-        else
+        record.PathOffset = blob.size();
+        AppendVarint(blob, shared);
+        AppendVarint(blob, path.size() - shared);
+        blob.append(path.substr(shared));
+        records.push_back(record);
+        previous.assign(path);
+    };
+
+    size_t next = 0;
+    std::string basePath;
+    for (size_t i = 0; i < BaseCount; ++i)
+    {
+        DecodeFrontCoded(BaseBlob + BaseRecords[i].PathOffset, basePath);
+        if (BaseState[i] & (BASE_OVERRIDDEN | BASE_REMOVED))
+        {
+            continue;
+        }
+        while (next < added.size() && added[next]->first < basePath)
         {
-            it->second.MissCount = 0;
-            it->second.Visited = false; // reset for next run
+            append(added[next]->first, ToCacheRecord(added[next]->second));
+            ++next;
         }
-        ++it;
+        CacheRecord record = BaseRecords[i];
+        record.MissCount = BaseEntry(i, std::string()).MissCount;
+        append(basePath, record);
     }
+    for (; next < added.size(); ++next)
+    {
+        append(added[next]->first, ToCacheRecord(added[next]->second));
+    }
+
+    CacheFileHeader header{};
+    header.Magic = CACHE_FILE_MAGIC;
+    header.Version = CACHE_FILE_VERSION;
+    header.EntryCount = records.size();
+    header.LastScanTime = LastScanTime;
+    header.BlobSize = blob.size();
+    header.RecordSize = sizeof(CacheRecord);
+    header.RestartInterval = CACHE_RESTART_INTERVAL;
+
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, records.data(), records.size() * sizeof(CacheRecord));
+    blake3_hasher_update(&hasher, blob.data(), blob.size());
+    blake3_hasher_finalize(&hasher, header.Checksum.data(), header.Checksum.size());
+
+    // Every mapped entry has been copied out above, Windows cannot replace a file that is still mapped
+    CloseBase();
+    // The header already carries the checksum, no trailer so the record array stays at a fixed offset from the end of the header
+    bool saved = AtomicFile::Write(MetaCacheSaveFilePath, {
+        std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)),
+        std::string_view(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(CacheRecord)),
+        blob }, false);
+    if (!saved)
+    {
+        Log.Error(std::string("[MetadataCache::Save]: Failed to Save Cache File: ") + MetaCacheSaveFilePath);
+    }
+    else
+    {
+        Log.Info(std::string("[MetaDataCache::Save] Successfully Saved ") + std::to_string(records.size()) + std::string(" Cache Entries: ") + MetaCacheSaveFilePath);
+    }
+    return LoadLocked(MetaDataCacheBinFileNumber) && saved;
 }
-/*
-void MetaDataCache::ResetVisitedFlags()
+
+bool MetaDataCache::HasEntry(const std::string& path) const
 {
-    for (auto& [path, info] : Entries)
+    std::shared_lock lock(MetaCacheMutex);
+    EntryShard& shard = ShardOf(path);
+    std::lock_guard shardLock(shard.ShardMutex);
+    if (shard.Entries.find(path) != shard.Entries.end())
     {
-        info.Visited = false;
+        return true;
     }
-}*/
+    size_t index = FindBase(path);
+    return index != SIZE_MAX && !(BaseState[index] & BASE_REMOVED);
+}
 
-std::unordered_map<std::string, FileInfo> MetaDataCache::GetAllEntries() const
+FileInfo MetaDataCache::GetEntry(const std::string& path) const
 {
-    std::lock_guard lock(MetaCacheMutex);
-    return Entries;
+    std::shared_lock lock(MetaCacheMutex);
+    EntryShard& shard = ShardOf(path);
+    std::lock_guard shardLock(shard.ShardMutex);
+    auto it = shard.Entries.find(path);
+    if (it != shard.Entries.end())
+    {
+        return it->second;
+    }
+    size_t index = FindBase(path);
+    if (index == SIZE_MAX || (BaseState[index] & BASE_REMOVED))
+    {
+        return FileInfo{};
+    }
+    return BaseEntry(index, path);
 }
 
-// Load copy status flags for BinIDs
-bool MetaDataCache::LoadCopiedState()
+uint64_t MetaDataCache::GetLastScanTime() const
 {
-    std::lock_guard lock(MetaCacheMutex);
-    IDCopiedFlag.clear();
+    std::shared_lock lock(MetaCacheMutex);
+    return LastScanTime;
+}
 
-    std::ifstream file(ConfigGlobal::StateIndexFileName, std::ios::binary);
+void MetaDataCache::SetLastScanTime(uint64_t ScanTime)
+{
+    std::unique_lock lock(MetaCacheMutex);
+    LastScanTime = ScanTime;
+}
 
-    if (!file)
+void MetaDataCache::MarkVisited(const std::string& path)
+{
+    std::shared_lock lock(MetaCacheMutex);
+    EntryShard& shard = ShardOf(path);
+    std::lock_guard shardLock(shard.ShardMutex);
+    auto it = shard.Entries.find(path);
+    if (it != shard.Entries.end())
     {
-        // No file yet is not an error(first run)
-        return true;
+        it->second.Visited = true;
+        it->second.MissCount = 0;
+        return;
     }
-
-    uint32_t count = 0;
-    file.read(reinterpret_cast<char*>(&count), sizeof(count));
-    if (!file)
+    size_t index = FindBase(path);
+    if (index != SIZE_MAX)
     {
-        return false;
+        BaseState[index] |= BASE_VISITED;
     }
+}
 
-    for (uint32_t i = 0; i < count; ++i)
+CacheMatch MetaDataCache::ClassifyAndMarkVisited(const FileInfo& file)
+{
+    std::shared_lock lock(MetaCacheMutex);
+    EntryShard& shard = ShardOf(file.AbsolutePath);
+    std::lock_guard shardLock(shard.ShardMutex);
+    auto it = shard.Entries.find(file.AbsolutePath);
+    if (it != shard.Entries.end())
     {
-        uint32_t id = 0;
-        bool copied = false;
-
-        file.read(reinterpret_cast<char*>(&id), sizeof(id));
-        file.read(reinterpret_cast<char*>(&copied), sizeof(copied));
-
-        if (!file)
+        FileInfo& cached = it->second;
+        cached.Visited = true;
+        cached.MissCount = 0;
+        if (cached.Hash != file.Hash)
         {
-            return false;
+            return CacheMatch::Changed;
         }
+        AssignAttributes(cached, file);
+        return CacheMatch::Unchanged;
+    }
+    size_t index = FindBase(file.AbsolutePath);
+    if (index == SIZE_MAX)
+    {
+        return CacheMatch::New;
+    }
+    uint8_t state = BaseState[index].fetch_or(BASE_VISITED);
+    if (state & BASE_REMOVED)
+    {
+        return CacheMatch::New;
+    }
+    if (BaseRecords[index].Hash != file.Hash)
+    {
+        return CacheMatch::Changed;
+    }
+    RefreshBase(shard, index, file);
+    return CacheMatch::Unchanged;
+}
 
-        IDCopiedFlag[id] = copied;
+bool MetaDataCache::VisitAttributes(std::string_view path, CachedAttributes& attributes)
+{
+    std::shared_lock lock(MetaCacheMutex);
+    EntryShard& shard = ShardOf(path);
+    std::lock_guard shardLock(shard.ShardMutex);
+    auto it = shard.Entries.find(path);
+    if (it != shard.Entries.end())
+    {
+        FileInfo& cached = it->second;
+        cached.Visited = true;
+        cached.MissCount = 0;
+        attributes.Size = cached.Size;
+        attributes.MTime = cached.MTime;
+        attributes.CTime = cached.CTime;
+        attributes.Inode = cached.Inode;
+        attributes.Hash = cached.Hash;
+        attributes.ContentHashed = cached.ContentHashed;
+        return true;
+    }
+    size_t index = FindBase(path);
+    if (index == SIZE_MAX)
+    {
+        return false;
+    }
+    uint8_t state = BaseState[index].fetch_or(BASE_VISITED);
+    if (state & BASE_REMOVED)
+    {
+        return false;
     }
-    Log.Info(std::string("[LoadCopiedState] Loaded ") + std::to_string(IDCopiedFlag.size()) + std::string(" entries."));
+    const CacheRecord& record = BaseRecords[index];
+    attributes.Size = record.Size;
+    attributes.MTime = record.MTime;
+    attributes.CTime = record.CTime;
+    attributes.Inode = record.Inode;
+    attributes.Hash = record.Hash;
+    attributes.ContentHashed = (record.Flags & CACHE_RECORD_CONTENT_HASHED) != 0;
     return true;
 }
 
-// Save copy status flags for BinIDs
-bool MetaDataCache::SaveCopiedState()
+// Caller holds the lock of the shard the path belongs to(or MetaCacheMutex exclusively)
+void MetaDataCache::RefreshBase(EntryShard& shard, size_t index, const FileInfo& file)
+{
+    if (SameRecord(BaseRecords[index], file))
+    {
+        return;
+    }
+    FileInfo refreshed = file;
+    refreshed.Visited = true;
+    refreshed.MissCount = 0;
+    InsertEntry(shard, std::move(refreshed));
+    BaseState[index] |= BASE_OVERRIDDEN;
+}
+
+void MetaDataCache::UpdateEntry(const std::string& path, const FileInfo& info)
 {
-    std::lock_guard lock(MetaCacheMutex);
-    std::ofstream file(ConfigGlobal::StateIndexFileName, std::ios::binary | std::ios::trunc);
-    if (!file) return false;
+    FileInfo newInfo = info;
+    newInfo.AbsolutePath = path;
+    UpdateEntry(std::move(newInfo));
+}
 
-    uint32_t count = static_cast<uint32_t>(IDCopiedFlag.size());
-    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
-    if (!file)
+void MetaDataCache::UpdateEntry(FileInfo&& info)
+{
+    std::shared_lock lock(MetaCacheMutex);
+    EntryShard& shard = ShardOf(info.AbsolutePath);
+    std::lock_guard shardLock(shard.ShardMutex);
+
+    auto it = shard.Entries.find(info.AbsolutePath);
+    if (it != shard.Entries.end())
     {
-        return false;
+        AssignAttributes(it->second, info);
+        it->second.Visited = true;
+        it->second.MissCount = 0;
+        return;
     }
 
-    for (const auto& [id, copied] : IDCopiedFlag)
+    size_t index = FindBase(info.AbsolutePath);
+    if (index != SIZE_MAX && !(BaseState[index] & (BASE_OVERRIDDEN | BASE_REMOVED)) && SameRecord(BaseRecords[index], info))
     {
-        file.write(reinterpret_cast<const char*>(&id), sizeof(id));
-        file.write(reinterpret_cast<const char*>(&copied), sizeof(copied));
-        if (!file)
-        {
-            return false;
-        }
+        BaseState[index] |= BASE_VISITED; // Mapped record is already up to date
+        return;
     }
-    Log.Info(std::string("[SaveCopiedState] Saved ") + std::to_string(IDCopiedFlag.size()) + std::string(" entries."));
-    return true;
+    if (index != SIZE_MAX)
+    {
+        BaseState[index] |= BASE_OVERRIDDEN;
+    }
+    // Insert new entry
+    info.Visited = true;
+    info.MissCount = 0;
+    InsertEntry(shard, std::move(info));
 }
 
-void MetaDataCache::ResetCopiedFlags()
+void MetaDataCache::DropStale(const std::string& path)
 {
-    LoadCopiedState();
+    if (ConfigGlobal::DeleteStaleFromDest)
     {
-        std::lock_guard lock(MetaCacheMutex);
-        for (auto& entry : IDCopiedFlag)
+        FileCopier::DeleteStaleFromDestination(path);
+    }
+    Log.Info(std::string("[RemoveStaleEntries] Deleted Stale Entry: ") + path);
+}
+
+void MetaDataCache::MissBaseEntry(size_t index, const std::string& path, int maxMissCount)
+{
+    if (BaseMissCount.empty())
+    {
+        BaseMissCount.resize(BaseCount);
+        for (size_t i = 0; i < BaseCount; ++i)
         {
-            entry.second = false;
+            BaseMissCount[i] = BaseRecords[i].MissCount;
         }
     }
-    SaveCopiedState();
-    Log.Info(std::string("[ResetCopiedFlags] Copy Flags Reset"));
+    if (BaseState[index] & (BASE_OVERRIDDEN | BASE_REMOVED))
+    {
+        return;
+    }
+    if (++BaseMissCount[index] > maxMissCount)
+    {
+        DropStale(path);
+        BaseState[index] |= BASE_REMOVED;
+    }
 }
-/*
-bool MetaDataCache::ResetCopiedFlagFor(uint32_t BinID)
+
+void MetaDataCache::RemoveStaleEntries(int maxMissCount)
 {
-    LoadCopiedState();
-    bool updated = false;
+    std::unique_lock lock(MetaCacheMutex);
+    if (StaleResolved)
     {
-        std::lock_guard lock(MetaCacheMutex);
+        return;
+    }
+    for (auto& shard : Shards)
+    {
+        for (auto it = shard.Entries.begin(); it != shard.Entries.end(); )
+        {
+            if (!it->second.Visited)
+            {
+                it->second.MissCount++;
+                if (it->second.MissCount > maxMissCount)
+                {
+                    DropStale(it->second.AbsolutePath);
+                    it = shard.Entries.erase(it);
+                    continue;
+                }
+            }
+            else
+            {
+                it->second.MissCount = 0;
+                it->second.Visited = false; // reset for next run
+            }
+            ++it;
+        }
+    }
 
-        auto it = IDCopiedFlag.find(BinID);
-        if (it != IDCopiedFlag.end())
+    if (BaseCount > 0 && BaseMissCount.empty())
+    {
+        BaseMissCount.resize(BaseCount);
+        for (size_t i = 0; i < BaseCount; ++i)
         {
-            it->second = false;
-            updated = true;
+            BaseMissCount[i] = BaseRecords[i].MissCount;
         }
     }
-    
-    if (updated)
+    std::string path;
+    for (size_t i = 0; i < BaseCount; ++i)
     {
-        Log.Info(std::string("[ResetCopiedFlagFor] Copy Flag Reset for BinID = ") + std::to_string(BinID));
-        return SaveCopiedState();
+        DecodeFrontCoded(BaseBlob + BaseRecords[i].PathOffset, path);
+        std::atomic<uint8_t>& state = BaseState[i];
+        if (state & (BASE_OVERRIDDEN | BASE_REMOVED))
+        {
+            continue;
+        }
+        if (state & BASE_VISITED)
+        {
+            BaseMissCount[i] = 0;
+            state &= static_cast<uint8_t>(~BASE_VISITED); // reset for next run
+            continue;
+        }
+        MissBaseEntry(i, path, maxMissCount);
     }
-    // Optional: insert new ID with false
-    // IDCopiedFlag[BinID] = false;
-    // return SaveCopiedState();
-    return false;
-} */
+}
 
-void MetaDataCache::MarkCopied(uint32_t BinID)
+// Both sides are in path order: the scan sorted by the caller, the mapped base as written by Save and the overlay sorted here.
+// Each side is walked once, matched entries are marked visited by position without a lookup, and every cached entry passed over
+// without a match is a file that disappeared from the source
+std::vector<CacheMatch> MetaDataCache::MergeJoin(const std::vector<FileInfo>& sortedFiles, int maxMissCount)
 {
-    LoadCopiedState();
+    std::unique_lock lock(MetaCacheMutex);
+    std::vector<CacheMatch> matches(sortedFiles.size(), CacheMatch::New);
+
+    std::vector<EntryMap::value_type*> overlay;
+    overlay.reserve(EntryCount());
+    for (auto& shard : Shards)
     {
-        std::lock_guard lock(MetaCacheMutex);
-        IDCopiedFlag[BinID] = true;
+        for (auto& entry : shard.Entries)
+        {
+            overlay.push_back(&entry);
+        }
     }
-    SaveCopiedState();
-    Log.Info(std::string("[MarkCopied] Copy Flag Set to True for BinID = ") + std::to_string(BinID));
-}
+    std::sort(overlay.begin(), overlay.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
 
-bool MetaDataCache::IsCopied(uint32_t BinID) const
-{
-    std::lock_guard lock(MetaCacheMutex);
-    auto it = IDCopiedFlag.find(BinID);
-    return it != IDCopiedFlag.end() && it->second;
+    size_t missing = 0;
+    auto missOverlay = [&](EntryMap::value_type* entry)
+    {
+        ++missing;
+        entry->second.Visited = false;
+        if (++entry->second.MissCount > maxMissCount)
+        {
+            DropStale(entry->second.AbsolutePath);
+            EntryShard& shard = ShardOf(entry->first);
+            shard.Entries.erase(shard.Entries.find(entry->first));
+        }
+    };
+
+    size_t overlayIndex = 0;
+    size_t baseIndex = 0;
+    std::string basePath;
+    if (BaseCount > 0)
+    {
+        DecodeFrontCoded(BaseBlob + BaseRecords[0].PathOffset, basePath);
+    }
+    auto nextBase = [&]()
+    {
+        if (++baseIndex < BaseCount)
+        {
+            DecodeFrontCoded(BaseBlob + BaseRecords[baseIndex].PathOffset, basePath);
+        }
+    };
+    auto missBase = [&]()
+    {
+        if (!(BaseState[baseIndex] & (BASE_OVERRIDDEN | BASE_REMOVED)))
+        {
+            ++missing;
+        }
+        MissBaseEntry(baseIndex, basePath, maxMissCount);
+        nextBase();
+    };
+
+    for (size_t i = 0; i < sortedFiles.size(); ++i)
+    {
+        const FileInfo& file = sortedFiles[i];
+        while (overlayIndex < overlay.size() && overlay[overlayIndex]->first < file.AbsolutePath)
+        {
+            missOverlay(overlay[overlayIndex++]);
+        }
+        while (baseIndex < BaseCount && basePath < file.AbsolutePath)
+        {
+            missBase();
+        }
+
+        bool inOverlay = overlayIndex < overlay.size() && overlay[overlayIndex]->first == file.AbsolutePath;
+        if (inOverlay)
+        {
+            FileInfo& cached = overlay[overlayIndex++]->second;
+            cached.Visited = true;
+            cached.MissCount = 0;
+            matches[i] = cached.Hash == file.Hash ? CacheMatch::Unchanged : CacheMatch::Changed;
+            if (matches[i] == CacheMatch::Unchanged)
+            {
+                AssignAttributes(cached, file);
+            }
+        }
+        if (baseIndex < BaseCount && basePath == file.AbsolutePath)
+        {
+            uint8_t state = BaseState[baseIndex].fetch_or(BASE_VISITED);
+            if (!inOverlay && !(state & (BASE_OVERRIDDEN | BASE_REMOVED)))
+            {
+                matches[i] = BaseRecords[baseIndex].Hash == file.Hash ? CacheMatch::Unchanged : CacheMatch::Changed;
+                if (matches[i] == CacheMatch::Unchanged)
+                {
+                    RefreshBase(ShardOf(file.AbsolutePath), baseIndex, file);
+                }
+            }
+            nextBase();
+        }
+    }
+    while (overlayIndex < overlay.size())
+    {
+        missOverlay(overlay[overlayIndex++]);
+    }
+    while (baseIndex < BaseCount)
+    {
+        missBase();
+    }
+
+    StaleResolved = true;
+    Log.Info(std::string("[MetaDataCache::MergeJoin] Scanned ") + std::to_string(sortedFiles.size()) + std::string(" | Cached ") +
+        std::to_string(BaseCount + overlay.size()) + std::string(" | Missing ") + std::to_string(missing));
+    return matches;
 }
+/*
+void MetaDataCache::ResetVisitedFlags()
+{
+    for (auto& [path, info] : Entries)
+    {
+        info.Visited = false;
+    }
+}*/
 
-const std::unordered_map<uint32_t, bool>& MetaDataCache::GetCopiedMap() const
+std::unordered_map<std::string, FileInfo> MetaDataCache::GetAllEntries() const
 {
-    return IDCopiedFlag;
+    std::unique_lock lock(MetaCacheMutex);
+    std::unordered_map<std::string, FileInfo> all;
+    all.reserve(EntryCount() + BaseCount);
+    for (const auto& shard : Shards)
+    {
+        for (const auto& [path, info] : shard.Entries)
+        {
+            all.emplace(path, info);
+        }
+    }
+    std::string path;
+    for (size_t i = 0; i < BaseCount; ++i)
+    {
+        DecodeFrontCoded(BaseBlob + BaseRecords[i].PathOffset, path);
+        if (!(BaseState[i] & (BASE_OVERRIDDEN | BASE_REMOVED)))
+        {
+            all.emplace(path, BaseEntry(i, path));
+        }
+    }
+    return all;
 }
 
 // Load Index storing Destination Path and Destination Cache Folder
@@ -370,8 +912,9 @@ void MetaDataCache::LoadDestinationIndex(std::unordered_map<std::string, uint32_
     PathToID.clear();
     IDToPath.clear();
 
-    std::ifstream file(ConfigGlobal::DestinationIndexFileName, std::ios::binary);
-    if (!file) return;
+    std::string contents;
+    if (AtomicFile::Read(ConfigGlobal::DestinationIndexFileName.string(), contents) != CacheReadStatus::Loaded) return;
+    std::istringstream file(contents);
 
     uint32_t count = 0;
     if (!ReadBinary(file, count)) return;
@@ -402,8 +945,7 @@ void MetaDataCache::SaveDestinationIndex(const std::unordered_map<std::string, u
         FS::create_directories(indexPath.parent_path());
     }
     
-    std::ofstream file(ConfigGlobal::DestinationIndexFileName, std::ios::binary | std::ios::trunc);
-    if (!file) return;
+    std::ostringstream file;
 
     uint32_t count = static_cast<uint32_t>(PathToID.size());
     WriteBinary(file, count);
@@ -415,7 +957,7 @@ void MetaDataCache::SaveDestinationIndex(const std::unordered_map<std::string, u
         WriteBinary(file, len);
         file.write(path.data(), len);
     }
-    file.flush();
+    if (!AtomicFile::Write(ConfigGlobal::DestinationIndexFileName.string(), { file.view() })) return;
     Log.Info(std::string("[SaveDestinationIndex] Saved Index"));
 }
 
@@ -441,114 +983,206 @@ uint32_t MetaDataCache::GetOrAddDestinationID()
     return id;
 }
 
-// Load Index storing Source Path and BinID
-void MetaDataCache::LoadIndex(std::unordered_map<std::string, uint32_t>& PathToID,std::unordered_map<uint32_t, std::string>& IDToPath)
+// Load per directory listings(path, mtime, children) remembered by the previous scan of this source
+bool MetaDataCache::LoadDirectoryIndex(uint32_t MetaDataCacheBinFileNumber, DirectoryIndex& Records)
 {
-    PathToID.clear();
-    IDToPath.clear();
-
-    std::ifstream file(ConfigGlobal::IndexFileName, std::ios::binary);
-    if (!file) return;
+    Records.clear();
+    std::string DirIndexFilePath = (ConfigGlobal::DestinationCacheDir / (std::to_string(MetaDataCacheBinFileNumber) + ".dirs")).string();
+    std::string contents;
+    CacheReadStatus status = AtomicFile::Read(DirIndexFilePath, contents);
+    if (status == CacheReadStatus::Missing)
+    {
+        // No index yet is not an error(first run or flag just enabled)
+        return true;
+    }
+    if (status == CacheReadStatus::Corrupt)
+    {
+        Log.Error(std::string("[LoadDirectoryIndex] Corrupt Directory Index, Ignoring: ") + DirIndexFilePath);
+        return false;
+    }
+    std::istringstream file(contents);
 
     uint32_t count = 0;
-    if (!ReadBinary(file, count)) return;
+    if (!ReadBinary(file, count)) return false;
+    Records.reserve(count);
 
     for (uint32_t i = 0; i < count; ++i)
     {
-        uint32_t id = 0;
         uint32_t pathLen = 0;
-
-        if (!ReadBinary(file, id)) break;
-        if (!ReadBinary(file, pathLen)) break;
+        if (!ReadBinary(file, pathLen) || pathLen == 0 || pathLen > 4096) break;
 
         std::string path(pathLen, '\0');
         if (!file.read(&path[0], pathLen)) break;
 
-        PathToID[path] = id;
-        IDToPath[id] = path;
+        DirectoryRecord record;
+        uint32_t childCount = 0;
+        if (!ReadBinary(file, record.MTime)) break;
+        if (!ReadBinary(file, childCount)) break;
+        record.Children.resize(childCount);
+
+        bool ok = true;
+        for (auto& child : record.Children)
+        {
+            uint16_t nameLen = 0;
+            if (!ReadBinary(file, child.Type) || !ReadBinary(file, nameLen) || nameLen == 0)
+            {
+                ok = false;
+                break;
+            }
+            child.Name.resize(nameLen);
+            if (!file.read(&child.Name[0], nameLen))
+            {
+                ok = false;
+                break;
+            }
+        }
+        if (!ok)
+        {
+            break;
+        }
+        Records.emplace(std::move(path), std::move(record));
     }
+
+    if (Records.size() != count)
+    {
+        // Truncated or corrupt, a full listing is always safe so just drop it
+        Log.Error(std::string("[LoadDirectoryIndex] Corrupt Directory Index, Ignoring: ") + DirIndexFilePath);
+        Records.clear();
+        return false;
+    }
+    Log.Info(std::string("[LoadDirectoryIndex] Loaded ") + std::to_string(Records.size()) + std::string(" Directory Records for BinID = ") + std::to_string(MetaDataCacheBinFileNumber));
+    return true;
 }
 
-// Save Index storing Source Path and BinID
-void MetaDataCache::SaveIndex(const std::unordered_map<std::string, uint32_t>& PathToID)
+// Save per directory listings for the next scan of this source
+bool MetaDataCache::SaveDirectoryIndex(uint32_t MetaDataCacheBinFileNumber, const DirectoryRecordList& Records)
 {
-    std::ofstream file(ConfigGlobal::IndexFileName, std::ios::binary | std::ios::trunc);
-    if (!file) return;
+    std::string DirIndexFilePath = (ConfigGlobal::DestinationCacheDir / (std::to_string(MetaDataCacheBinFileNumber) + ".dirs")).string();
+    std::ostringstream file;
 
-    uint32_t count = static_cast<uint32_t>(PathToID.size());
-    WriteBinary(file, count);
-    
-    for (const auto& [path, id] : PathToID)
+    uint32_t count = static_cast<uint32_t>(Records.size());
+    if (!WriteBinary(file, count)) return false;
+
+    for (const auto& [path, record] : Records)
     {
-        WriteBinary(file, id);
-        uint32_t len = static_cast<uint32_t>(path.size());
-        WriteBinary(file, len);
-        file.write(path.data(), len);
+        uint32_t pathLen = static_cast<uint32_t>(path.size());
+        uint32_t childCount = static_cast<uint32_t>(record.Children.size());
+        if (!WriteBinary(file, pathLen)) return false;
+        if (!file.write(path.data(), pathLen)) return false;
+        if (!WriteBinary(file, record.MTime)) return false;
+        if (!WriteBinary(file, childCount)) return false;
+        for (const auto& child : record.Children)
+        {
+            uint16_t nameLen = static_cast<uint16_t>(child.Name.size()); // NAME_MAX is 255
+            if (!WriteBinary(file, child.Type)) return false;
+            if (!WriteBinary(file, nameLen)) return false;
+            if (!file.write(child.Name.data(), nameLen)) return false;
+        }
+    }
+    if (!AtomicFile::Write(DirIndexFilePath, { file.view() }))
+    {
+        Log.Error(std::string("[SaveDirectoryIndex] Failed to Save Directory Index: ") + DirIndexFilePath);
+        return false;
     }
-    file.flush();
+    Log.Info(std::string("[SaveDirectoryIndex] Saved ") + std::to_string(Records.size()) + std::string(" Directory Records for BinID = ") + std::to_string(MetaDataCacheBinFileNumber));
+    return true;
 }
 
-std::string MetaDataCache::GetPathFromSourceID(uint32_t sourceID)
+// Streams one source through scan -> hash -> diff -> copy. The scanner runs on its own thread and hands batches over a bounded queue,
+// this thread hashes and diffs each batch and submits it to the copy queue straight away, so copying starts long before the scan ends.
+void MetaDataCache::ScanAndSyncSource(const std::string& sourcePath, const std::vector<std::string>& excludes)
 {
-    std::unordered_map<std::string, uint32_t> PathToID;
-    std::unordered_map<uint32_t, std::string> IDToPath;
-    LoadIndex(PathToID, IDToPath);
+    // Assigned by SourceIndex::Build before any source is synced
+    uint32_t id = SourceIndex::IDOf(sourcePath);
+
+    // Usually prefetched while earlier sources were scanning, journal already replayed
+    std::shared_ptr<MetaDataCache> cache = CacheStore::Acquire(id);
 
-    auto it = IDToPath.find(sourceID);
-    if (it != IDToPath.end())
+    uint64_t previousScanTime = cache->GetLastScanTime();
+    uint64_t currentScanTime = ToTimeT(FS::file_time_type::clock::now());
+    cache->SetLastScanTime(currentScanTime);
+
+    FileScanner Scanner;
+    Scanner.SetExcludes(excludes);
+    if (ConfigGlobal::DirectorySkipIndex)
     {
-        return it->second;
+        DirectoryIndex PreviousDirRecords;
+        LoadDirectoryIndex(id, PreviousDirRecords);
+        Scanner.SetPreviousDirectoryIndex(std::move(PreviousDirRecords));
     }
 
-    return {}; // Return empty string if not found
-}
+    BoundedQueue<std::vector<ScannedFileInfo>> ScanQueue(PIPELINE_QUEUE_DEPTH);
+    Scanner.SetBatchCallback(PIPELINE_BATCH_SIZE, [&ScanQueue](std::vector<ScannedFileInfo>&& batch)
+    {
+        ScanQueue.Push(std::move(batch));
+    });
 
-void MetaDataCache::UpdateCacheForSource(const std::string& sourcePath, const std::vector<ScannedFileInfo>& scannedFiles)
-{
-    // Assign ID if new
-    uint32_t id = 0;
+    std::cout << "Scanning: " << sourcePath << std::endl;
+    std::thread ScanThread([&Scanner, &ScanQueue, &sourcePath]()
     {
-        std::lock_guard lock(IndexMutex);
-        std::unordered_map<std::string, uint32_t> PathToID;
-        std::unordered_map<uint32_t, std::string> IDToPath;
-        LoadIndex(PathToID, IDToPath);
+        Scanner.Scan(sourcePath);
+        ScanQueue.Close();
+    });
 
-        if (PathToID.count(sourcePath))
+    FileHasher Hasher;
+    std::vector<FileInfo> batchFiles; // Reused for every batch, changed files are moved out of it into the copy queue
+    std::vector<FileInfo> sortedFiles; // MergeJoin only, the whole scan waiting for the diff
+    std::vector<ScannedFileInfo> scannedBatch;
+    size_t scannedCount = 0;
+    bool anySubmitted = false;
+    bool mergeJoin = ConfigGlobal::DiffMode == "MergeJoin"; // Batches are only hashed, the diff waits for the complete scan
+    while (ScanQueue.Pop(scannedBatch))
+    {
+        batchFiles.clear();
+        batchFiles.reserve(scannedBatch.size());
+        scannedCount += scannedBatch.size();
+        for (const auto& file : scannedBatch)
         {
-            id = PathToID[sourcePath];
+            FileInfo info;
+            info.AbsolutePath = Scanner.GetPaths().Join(file.DirID, file.Name);
+            info.Size = file.Size;
+            info.MTime = file.MTime;
+            info.CTime = file.CTime;
+            info.Inode = file.Inode;
+            batchFiles.push_back(std::move(info));
+        }
+        if (ConfigGlobal::ChangeDetection == "Hybrid")
+        {
+            // The metadata checks already looked every file up, the lookup diff reuses their result
+            std::vector<CacheMatch> matches = SyncEngine::ResolveHybridHashes(batchFiles, *cache, previousScanTime, currentScanTime, Hasher);
+            if (!mergeJoin)
+            {
+                anySubmitted |= SyncEngine::SyncBatch(batchFiles, matches, cache, id);
+                continue;
+            }
         }
         else
         {
-            id = static_cast<uint32_t>(PathToID.size() + 1);
-            PathToID[sourcePath] = id;
-            IDToPath[id] = sourcePath;
-            SaveIndex(PathToID);
+            Hasher.HashFiles(batchFiles);
+        }
+        if (mergeJoin)
+        {
+            std::move(batchFiles.begin(), batchFiles.end(), std::back_inserter(sortedFiles));
+        }
+        else
+        {
+            anySubmitted |= SyncEngine::SyncBatch(batchFiles, cache, id);
         }
     }
+    ScanThread.join();
 
-    std::string cacheFilePath = (ConfigGlobal::DestinationCacheDir / (std::to_string(id) + ".bin")).string();
-
-    MetaDataCache cache(cacheFilePath);
-    if (!cache.Load(id))
+    if (mergeJoin)
     {
-        Log.Info(std::string("[UpdateCacheForSource] Failed to Load Cache File ]") + cacheFilePath);
+        anySubmitted = SyncEngine::SyncSorted(sortedFiles, cache, id);
+        sortedFiles = {}; // Changed files live in the copy queue now, release the rest before the copy runs
     }
-    else
+
+    if (ConfigGlobal::DirectorySkipIndex)
     {
-        Log.Info(std::string("[UpdateCacheForSource] Cache Loaded Successfully."));
+        SaveDirectoryIndex(id, Scanner.GetDirectoryRecords());
     }
 
-    FileHasher Hasher;
-    std::vector<FileInfo> freshFiles;
-    for (const auto& file : scannedFiles)
-    {
-        FileInfo info;
-        info.AbsolutePath = file.RelativePath;
-        info.Size = file.Size;
-        info.MTime = file.MTime;
-        freshFiles.push_back(std::move(info));
-    }
-    Hasher.HashFiles(freshFiles);
-    Log.Info(std::string("Completed Hashing for Source: ") + sourcePath);
-    SyncEngine::Sync(std::move(freshFiles), cache, id);
-}
\ No newline at end of file
+    Log.Info(std::string("Completed Scanning and Hashing for Source: ") + sourcePath + std::string(" | Files: ") + std::to_string(scannedCount) +
+        std::string(" | Directories: ") + std::to_string(Scanner.GetPaths().DirectoryCount()) + std::string(" | Name Bytes: ") + std::to_string(Scanner.GetPaths().NameBytes()));
+    SyncEngine::FinishSource(cache, id, anySubmitted);
+}
@@ -0,0 +1,88 @@
+#include "PathArena.hpp"
+
+#include <filesystem>
+#include <cstring>
+#include <algorithm>
+
+constexpr size_t PATH_ARENA_CHUNK_SIZE = 256 * 1024; // Names per chunk allocation, longer names get a chunk of their own
+
+uint32_t PathArena::InternDirectory(std::string_view DirPath)
+{
+    {
+        std::shared_lock lock(DirMutex);
+        auto it = DirectoryIDs.find(DirPath);
+        if (it != DirectoryIDs.end())
+        {
+            return it->second;
+        }
+    }
+
+    std::unique_lock lock(DirMutex);
+    auto it = DirectoryIDs.find(DirPath);
+    if (it != DirectoryIDs.end())
+    {
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(Directories.size());
+    const std::string& stored = Directories.emplace_back(DirPath);
+    DirectoryIDs.emplace(stored, id);
+    return id;
+}
+
+std::string_view PathArena::StoreName(std::string_view Name)
+{
+    std::lock_guard lock(NameMutex);
+    if (ChunkUsed + Name.size() > ChunkCapacity)
+    {
+        ChunkCapacity = std::max(PATH_ARENA_CHUNK_SIZE, Name.size());
+        Chunks.push_back(std::make_unique<char[]>(ChunkCapacity));
+        ChunkUsed = 0;
+    }
+    char* stored = Chunks.back().get() + ChunkUsed;
+    std::memcpy(stored, Name.data(), Name.size());
+    ChunkUsed += Name.size();
+    StoredBytes += Name.size();
+    return std::string_view(stored, Name.size());
+}
+
+std::string PathArena::Join(uint32_t DirID, std::string_view Name) const
+{
+    constexpr char Separator = static_cast<char>(std::filesystem::path::preferred_separator);
+    std::shared_lock lock(DirMutex);
+    const std::string& dir = Directories[DirID];
+    bool needsSeparator = !dir.empty() && dir.back() != Separator && dir.back() != '/';
+
+    std::string path;
+    path.reserve(dir.size() + needsSeparator + Name.size());
+    path.append(dir);
+    if (needsSeparator)
+    {
+        path.push_back(Separator);
+    }
+    path.append(Name);
+    return path;
+}
+
+size_t PathArena::DirectoryCount() const
+{
+    std::shared_lock lock(DirMutex);
+    return Directories.size();
+}
+
+size_t PathArena::NameBytes() const
+{
+    std::lock_guard lock(NameMutex);
+    return StoredBytes;
+}
+
+void PathArena::Clear()
+{
+    std::unique_lock dirLock(DirMutex);
+    std::lock_guard nameLock(NameMutex);
+    DirectoryIDs.clear();
+    Directories.clear();
+    Chunks.clear();
+    ChunkUsed = 0;
+    ChunkCapacity = 0;
+    StoredBytes = 0;
+}
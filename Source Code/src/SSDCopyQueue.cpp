@@ -1,6 +1,9 @@
 #include "SSDCopyQueue.hpp"
 #include "ConfigGlobal.hpp"
 #include "FileCopier.hpp"
+#include "SourceIndex.hpp"
+#include "CopyState.hpp"
+#include "CacheStore.hpp"
 #include <iostream>
 #include <filesystem>
 
@@ -19,12 +22,6 @@ SSDCopyQueue::~SSDCopyQueue()
 
 void SSDCopyQueue::Start()
 {
-    if (!SSDCopyStateCache.LoadCopiedState())
-    {
-        std::cerr << "[ERROR] Failed to load copy state file." << std::endl;
-        Log.Error("[SSDCopyQueue] Failed to load copy state file.");
-    }
-
     SSDLargeFileThreadRunning = true;
     SmallFileThreadPool = std::make_unique<ThreadPool>(ConfigGlobal::ParallelFilesPerSourceCount);
 
@@ -50,6 +47,7 @@ void SSDCopyQueue::Stop()
     {
         SSDLargeFileThread.join();
     }
+    Journal.Flush();
 }
 
 void SSDCopyQueue::IncrementPendingSources()
@@ -82,20 +80,25 @@ void SSDCopyQueue::WaitUntilDone()
         });
 }
 
-void SSDCopyQueue::SubmitCopyQueues(uint32_t sourceID, std::queue<FileInfo>&& smallFiles, std::queue<FileInfo>&& largeFiles, std::vector<FileInfo> freshFiles)
+void SSDCopyQueue::SubmitCopyQueues(uint32_t sourceID, std::queue<FileInfo>&& smallFiles, std::queue<FileInfo>&& largeFiles, bool finalBatch, std::shared_ptr<MetaDataCache> sourceCache)
 {
     {
         std::lock_guard<std::mutex> lock(SSDQueueMutex);
 
-        auto [it, inserted] = SSDSourceStatusMap.try_emplace(sourceID);
-
-        if (inserted)
+        // A source arrives as several batches, each batch adds its small and large queue and the source closes once all of them are done after the final batch
+        SourceCopyStatus& status = SSDSourceStatusMap[sourceID];
+        status.PendingQueues += 2;
+        if (sourceCache)
+        {
+            status.SourceCache = sourceCache; // The status outlives every queue of the source, the large file worker takes the cache from here
+        }
+        if (finalBatch)
         {
-            it->second.SmallDone.store(false);
-            it->second.LargeDone.store(false);
+            status.FinalSubmitted = true;
         }
-        it->second.FreshFiles = std::move(freshFiles);
     }
+    // Owned by SourceIndex and unchanged for the rest of the run, copy jobs hold it by reference
+    const std::string& sourceRoot = SourceIndex::PathOf(sourceID);
     Log.Info("[SSDCopyQueue] Submitting copy queues for source " + std::to_string(sourceID) + " small files: " + std::to_string(smallFiles.size()) + ", large files: " + std::to_string(largeFiles.size()));
 
     if (!smallFiles.empty())
@@ -103,12 +106,12 @@ void SSDCopyQueue::SubmitCopyQueues(uint32_t sourceID, std::queue<FileInfo>&& sm
         switch (CopyMode)
         {
         case SSDMode::Sequential:
-            MarkQueueDoneAndCheck(sourceID, true);
+            MarkQueueDoneAndCheck(sourceID);
         break;
 
         case SSDMode::Parallel:
         case SSDMode::Balanced:
-            ProcessSmallFiles(sourceID, std::move(smallFiles));
+            ProcessSmallFiles(sourceID, sourceRoot, sourceCache, std::move(smallFiles));
         break;
 
 		case SSDMode::GodSpeed:
@@ -122,7 +125,8 @@ void SSDCopyQueue::SubmitCopyQueues(uint32_t sourceID, std::queue<FileInfo>&& sm
 			}
 
 			// Submit entire source copy job to GodSpeedSourcePool
-			GodSpeedSourcePool->Submit([this, sourceID, fileVec = std::move(fileVec), freshFiles = std::move(freshFiles), largeFiles = std::move(largeFiles)]() mutable
+			// Large queue is closed by the caller below, this job only owns the small files
+			GodSpeedSourcePool->Submit([this, sourceID, &sourceRoot, sourceCache, fileVec = std::move(fileVec)]() mutable
 		    {
 				// Lock to safely access/modify per-source thread pools map
 				std::shared_ptr<ThreadPool> perSourcePool;
@@ -149,37 +153,32 @@ void SSDCopyQueue::SubmitCopyQueues(uint32_t sourceID, std::queue<FileInfo>&& sm
 				// Submit each small file copy to the per-source thread pool
 				for (auto& file : fileVec)
 				{
-					perSourcePool->Submit([this, file, sourceID, filesProcessed, totalFiles]()
+					perSourcePool->Submit([this, file = std::move(file), sourceID, &sourceRoot, sourceCache, filesProcessed, totalFiles]() mutable
 						{
-                            std::string SourceTopRootPath = SSDCopyStateCache.GetPathFromSourceID(sourceID);
-                            bool success = FileCopier::PerformFileCopy(file.AbsolutePath, SourceTopRootPath);
+                            bool success = FileCopier::PerformFileCopy(file.AbsolutePath, sourceRoot);
 							if (!success)
 							{
 								Log.Error("[SSDCopyQueue] File copy failed (small files queue): " + file.AbsolutePath);
 							}
+							else
+							{
+								RecordCopied(sourceID, sourceCache.get(), std::move(file));
+							}
 							size_t done = ++(*filesProcessed);
 							if (done == totalFiles)
 							{
-								MarkQueueDoneAndCheck(sourceID, true);
+								MarkQueueDoneAndCheck(sourceID);
 							}
 						});
 				}
 
-				if (!largeFiles.empty())
-				{
-					MarkQueueDoneAndCheck(sourceID, false);
-				}
-				else
-				{
-					MarkQueueDoneAndCheck(sourceID, false);
-				}
 			});
 			break;
 		}
     }
     else
     {
-        MarkQueueDoneAndCheck(sourceID, true);
+        MarkQueueDoneAndCheck(sourceID);
     }
 
     if (!largeFiles.empty())
@@ -197,21 +196,21 @@ void SSDCopyQueue::SubmitCopyQueues(uint32_t sourceID, std::queue<FileInfo>&& sm
 
         case SSDMode::Parallel:
         case SSDMode::GodSpeed:
-            MarkQueueDoneAndCheck(sourceID, false);
+            MarkQueueDoneAndCheck(sourceID);
         break;
         }
     }
     else
     {
-        MarkQueueDoneAndCheck(sourceID, false);
+        MarkQueueDoneAndCheck(sourceID);
     }
 }
 
-void SSDCopyQueue::ProcessSmallFiles(uint32_t sourceID, std::queue<FileInfo>&& files)
+void SSDCopyQueue::ProcessSmallFiles(uint32_t sourceID, const std::string& sourceRoot, const std::shared_ptr<MetaDataCache>& sourceCache, std::queue<FileInfo>&& files)
 {
     if (files.empty())
     {
-        MarkQueueDoneAndCheck(sourceID, true);
+        MarkQueueDoneAndCheck(sourceID);
         return;
     }
 
@@ -231,21 +230,21 @@ void SSDCopyQueue::ProcessSmallFiles(uint32_t sourceID, std::queue<FileInfo>&& f
 
     for (auto& file : fileVec)
     {
-        SmallFileThreadPool->Submit([this, file, sourceID, filesProcessed, fileCount]() mutable {
-            std::string SourceTopRootPath = SSDCopyStateCache.GetPathFromSourceID(sourceID);
-            bool success = FileCopier::PerformFileCopy(file.AbsolutePath, SourceTopRootPath);
+        SmallFileThreadPool->Submit([this, file = std::move(file), sourceID, &sourceRoot, sourceCache, filesProcessed, fileCount]() mutable {
+            bool success = FileCopier::PerformFileCopy(file.AbsolutePath, sourceRoot);
             if (success)
             {
-                size_t done = ++(*filesProcessed);
-                if (done == fileCount)
-                {
-                    MarkQueueDoneAndCheck(sourceID, true);
-                }
+                RecordCopied(sourceID, sourceCache.get(), std::move(file));
             }
             else
             {
                 Log.Error("[SSDCopyQueue] File copy failed (small files queue): " + file.AbsolutePath);
-
+            }
+            // Failed files count as processed too, the queue still has to close for the source to finish
+            size_t done = ++(*filesProcessed);
+            if (done == fileCount)
+            {
+                MarkQueueDoneAndCheck(sourceID);
             }
         });
     }
@@ -256,6 +255,7 @@ void SSDCopyQueue::LargeFileWorker()
     while (true)
     {
         std::pair<uint32_t, std::queue<FileInfo>> currentLargeQueue;
+        std::shared_ptr<MetaDataCache> sourceCache;
         {
             std::unique_lock<std::mutex> lock(SSDLargeQueueMutex);
             SSDLargeQueueCV.wait(lock, [this]() { return !SSDLargeFileQueue.empty() || !SSDLargeFileThreadRunning; });
@@ -272,12 +272,18 @@ void SSDCopyQueue::LargeFileWorker()
                 }
                 currentLargeQueue = std::move(SSDLargeFileQueue.front());
                 SSDLargeFileQueue.pop();
+                auto status = SSDSourceStatusMap.find(currentLargeQueue.first);
+                if (status != SSDSourceStatusMap.end())
+                {
+                    sourceCache = status->second.SourceCache;
+                }
             }
         }
 
         uint32_t sourceID = currentLargeQueue.first;
         std::queue<FileInfo>& fileQueue = currentLargeQueue.second;
 
+        const std::string& SourceTopRootPath = SourceIndex::PathOf(sourceID);
         Log.Info("[SSDCopyQueue] Processing large files sequentially for source " + std::to_string(sourceID) + ", file count: " + std::to_string(fileQueue.size()));
 
         while (!fileQueue.empty())
@@ -285,18 +291,31 @@ void SSDCopyQueue::LargeFileWorker()
             FileInfo file = std::move(fileQueue.front());
             fileQueue.pop();
 
-            std::string SourceTopRootPath = SSDCopyStateCache.GetPathFromSourceID(sourceID);
             bool success = FileCopier::PerformFileCopy(file.AbsolutePath, SourceTopRootPath);
             if (!success)
             {
                 Log.Error("[SSDCopyQueue] File copy failed (large files queue): " + file.AbsolutePath);
             }
+            else
+            {
+                RecordCopied(sourceID, sourceCache.get(), std::move(file));
+            }
         }
-        MarkQueueDoneAndCheck(sourceID, false);
+        MarkQueueDoneAndCheck(sourceID);
+    }
+}
+
+// Journals the copied file and moves it into the source's cache, saved once the whole source is done
+void SSDCopyQueue::RecordCopied(uint32_t sourceID, MetaDataCache* sourceCache, FileInfo&& file)
+{
+    Journal.Record(sourceID, file);
+    if (sourceCache)
+    {
+        sourceCache->UpdateEntry(std::move(file));
     }
 }
 
-void SSDCopyQueue::MarkQueueDoneAndCheck(uint32_t sourceID, bool isSmallQueue)
+void SSDCopyQueue::MarkQueueDoneAndCheck(uint32_t sourceID)
 {
     std::lock_guard<std::mutex> lock(SSDQueueMutex);
 
@@ -309,27 +328,26 @@ void SSDCopyQueue::MarkQueueDoneAndCheck(uint32_t sourceID, bool isSmallQueue)
 
     SourceCopyStatus& status = it->second;
 
-    if (isSmallQueue)
-        status.SmallDone.store(true);
-    else
-        status.LargeDone.store(true);
+    if (status.PendingQueues > 0)
+        --status.PendingQueues;
 
-    if (status.SmallDone.load() && status.LargeDone.load())
+    if (status.PendingQueues == 0 && status.FinalSubmitted)
     {
         // Batch update cache after all files copied for source
-        for (const auto& fileInfo : status.FreshFiles)
-        {
-            SSDCopyStateCache.UpdateEntry(fileInfo.AbsolutePath, fileInfo);
-        }
-
-        SSDCopyStateCache.RemoveStaleEntries(ConfigGlobal::StaleEntries);
-
-        if (!SSDCopyStateCache.Save(sourceID))
+        std::shared_ptr<MetaDataCache> sourceCachePtr = status.SourceCache ? status.SourceCache : std::make_shared<MetaDataCache>();
+        // Saved in the background, SSDQueueMutex is not held while the bin is serialized
+        CacheStore::Save(std::move(sourceCachePtr), sourceID, [this, sourceID](bool saved)
         {
-            Log.Error("[SSDCopyQueue] Failed to save cache for source: " + std::to_string(sourceID));
-        }
-
-        SSDCopyStateCache.MarkCopied(sourceID);
+            if (!saved)
+            {
+                Journal.Flush();
+            }
+            else
+            {
+                Journal.Discard(sourceID); // Everything it recorded is in the saved cache now
+            }
+            CopyState::MarkCopied(sourceID);
+        });
 
         SSDSourceStatusMap.erase(it);
 
@@ -0,0 +1,106 @@
+#include "SourceIndex.hpp"
+#include "AtomicFile.hpp"
+#include "ConfigGlobal.hpp"
+#include "Logger.hpp"
+
+#include <sstream>
+
+std::unordered_map<std::string, uint32_t> SourceIndex::PathToID;
+std::unordered_map<uint32_t, std::string> SourceIndex::IDToPath;
+
+template<typename T>
+static bool ReadBinary(std::istream& stream, T& value)
+{
+    return static_cast<bool>(stream.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template<typename T>
+static bool WriteBinary(std::ostream& stream, const T& value)
+{
+    return static_cast<bool>(stream.write(reinterpret_cast<const char*>(&value), sizeof(T)));
+}
+
+// Load Index storing Source Path and BinID
+void SourceIndex::Load()
+{
+    PathToID.clear();
+    IDToPath.clear();
+
+    std::string contents;
+    if (AtomicFile::Read(ConfigGlobal::IndexFileName.string(), contents) != CacheReadStatus::Loaded) return;
+    std::istringstream file(contents);
+
+    uint32_t count = 0;
+    if (!ReadBinary(file, count)) return;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t id = 0;
+        uint32_t pathLen = 0;
+
+        if (!ReadBinary(file, id)) break;
+        if (!ReadBinary(file, pathLen)) break;
+
+        std::string path(pathLen, '\0');
+        if (!file.read(&path[0], pathLen)) break;
+
+        PathToID[path] = id;
+        IDToPath[id] = path;
+    }
+    Log.Info(std::string("[SourceIndex] Loaded ") + std::to_string(PathToID.size()) + std::string(" Sources"));
+}
+
+// Save Index storing Source Path and BinID
+void SourceIndex::Save()
+{
+    std::ostringstream file;
+
+    uint32_t count = static_cast<uint32_t>(PathToID.size());
+    WriteBinary(file, count);
+
+    for (const auto& [path, id] : PathToID)
+    {
+        WriteBinary(file, id);
+        uint32_t len = static_cast<uint32_t>(path.size());
+        WriteBinary(file, len);
+        file.write(path.data(), len);
+    }
+    AtomicFile::Write(ConfigGlobal::IndexFileName.string(), { file.view() });
+}
+
+void SourceIndex::Build(const std::vector<std::string>& Sources)
+{
+    Load();
+
+    bool added = false;
+    for (const auto& sourcePath : Sources)
+    {
+        if (PathToID.count(sourcePath))
+        {
+            continue;
+        }
+        uint32_t id = static_cast<uint32_t>(PathToID.size() + 1);
+        PathToID[sourcePath] = id;
+        IDToPath[id] = sourcePath;
+        added = true;
+        Log.Info(std::string("[SourceIndex] New Source: ") + sourcePath + std::string(" | BinID = ") + std::to_string(id));
+    }
+
+    if (added)
+    {
+        Save();
+    }
+}
+
+uint32_t SourceIndex::IDOf(const std::string& SourcePath)
+{
+    auto it = PathToID.find(SourcePath);
+    return (it != PathToID.end()) ? it->second : 0;
+}
+
+const std::string& SourceIndex::PathOf(uint32_t BinID)
+{
+    static const std::string Unknown;
+    auto it = IDToPath.find(BinID);
+    return (it != IDToPath.end()) ? it->second : Unknown;
+}
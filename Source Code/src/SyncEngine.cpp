@@ -2,9 +2,13 @@
 #include "FileCopier.hpp"
 #include "ConfigGlobal.hpp"
 #include "Logger.hpp"
+#include "CopyJournal.hpp"
+#include "CacheStore.hpp"
 
 #include <filesystem>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 
 void SyncEngine::SetHDDCopyQueue(HDDCopyQueue* manager)
 {
@@ -17,204 +21,262 @@ void SyncEngine::SetSSDCopyQueue(SSDCopyQueue* manager)
 }
 
 constexpr size_t LARGE_FILE_THRESHOLD = 2ULL * 1024 * 1024 * 1024; // 2GB threshold
+constexpr size_t CLASSIFY_GRAIN = 512; // Files per chunk claimed by a pool thread during the diff
+constexpr size_t SORT_RUN_SIZE = 16384; // Files sorted by one pool thread before the runs are merged
+constexpr int64_t RACY_WINDOW_NS = 2'000'000'000; // Timestamp granularity margin, a file modified this close to the previous scan may have changed again within the same tick
 
-void SyncEngine::Sync(std::vector<FileInfo> freshFiles, MetaDataCache& cache, uint32_t MetaDataCacheBinFileNumber)
+// Size + mtime + inode + ctime all unchanged and the file was not modified around the previous scan: the cached hash is reused without reading the file.
+// Size or mtime changed, or the file is new: metadata hash, the file is copied anyway. If it was modified within the racy window of the current
+// scan its contents are hashed instead, the next run will find it racy and needs a content hash to compare against.
+// Size and mtime unchanged but inode or ctime moved(rewritten with a preserved mtime, replaced by rename), or mtime inside the racy window
+// of the previous scan: the metadata cannot be trusted, so the contents are hashed and compared.
+// Entries without inode/ctime(headerless bin, Windows, std::filesystem scan) fall back to size + mtime plus the racy window.
+// Files decided from metadata are classified by the same lookup, the content hashed ones are classified against the cache once hashed
+std::vector<CacheMatch> SyncEngine::ResolveHybridHashes(std::vector<FileInfo>& batchFiles, MetaDataCache& cache, uint64_t previousScanTime, uint64_t currentScanTime, FileHasher& hasher)
 {
-    if (ConfigGlobal::DiskType == "SSD")
+    std::vector<CacheMatch> matches(batchFiles.size(), CacheMatch::New);
+    std::vector<size_t> ambiguous;
+    for (size_t i = 0; i < batchFiles.size(); ++i)
     {
-        std::queue<FileInfo> smallFilesQueue;
-        std::queue<FileInfo> largeFilesQueue;
-        bool hasFilesToCopy = false;
-        
-        switch (ToSSDMode(ConfigGlobal::SSDMode))
+        FileInfo& file = batchFiles[i];
+        CachedAttributes cached;
+        bool found = cache.VisitAttributes(file.AbsolutePath, cached);
+
+        if (!found || cached.Size != file.Size || cached.MTime != file.MTime)
         {
-        case SSDMode::Sequential:
-            for (const auto& file : freshFiles)
+            matches[i] = found ? CacheMatch::Changed : CacheMatch::New;
+            if (static_cast<int64_t>(file.MTime) >= static_cast<int64_t>(currentScanTime) - RACY_WINDOW_NS)
             {
-                const std::string& absPath = file.AbsolutePath;
+                ambiguous.push_back(i);
+            }
+            else
+            {
+                hasher.HashSingleFile(file, false);
+            }
+            continue;
+        }
 
-                bool isNew = !cache.HasEntry(absPath);
-                bool isChanged = false;
+        bool attributesKnown = cached.Inode != 0 || cached.CTime != 0;
+        bool attributesMoved = attributesKnown && (cached.Inode != file.Inode || cached.CTime != file.CTime);
+        bool racy = previousScanTime != 0 && static_cast<int64_t>(file.MTime) >= static_cast<int64_t>(previousScanTime) - RACY_WINDOW_NS;
+        if (attributesMoved || racy)
+        {
+            ambiguous.push_back(i);
+            continue;
+        }
 
-                if (!isNew)
-                {
-                    FileInfo cached = cache.GetEntry(absPath);
-                    if (cached.Hash != file.Hash)
-                    {
-                        isChanged = true;
-                    }
-                }
+        file.Hash = cached.Hash;
+        file.ContentHashed = cached.ContentHashed;
+        matches[i] = CacheMatch::Unchanged;
+    }
 
-                if (isNew || isChanged)
-                {
-                    hasFilesToCopy = true;
-                    Log.Info(std::string("[Sync Engine] File marked for copy: ") + absPath);
-                    largeFilesQueue.emplace(file);
-                }
-                else
-                {
-                    Log.Info(std::string("[Sync Engine] File skipped (up-to-date): ") + absPath);
-                }
+    if (ambiguous.empty())
+    {
+        return matches;
+    }
 
-                cache.MarkVisited(absPath);
-            }
-            break;
-        case SSDMode::Parallel:
-        case SSDMode::GodSpeed:
-            for (const auto& file : freshFiles)
-            {
-                const std::string& absPath = file.AbsolutePath;
+    std::vector<FileInfo> contentFiles;
+    contentFiles.reserve(ambiguous.size());
+    for (size_t index : ambiguous)
+    {
+        contentFiles.push_back(std::move(batchFiles[index]));
+    }
+    hasher.HashFiles(contentFiles, true);
+    for (size_t i = 0; i < ambiguous.size(); ++i)
+    {
+        FileInfo& file = batchFiles[ambiguous[i]];
+        file = std::move(contentFiles[i]);
+        matches[ambiguous[i]] = cache.ClassifyAndMarkVisited(file);
+    }
+    Log.Info(std::string("[Sync Engine] Hybrid change detection content hashed ") + std::to_string(ambiguous.size()) + std::string(" of ") + std::to_string(batchFiles.size()) + std::string(" files"));
+    return matches;
+}
+
+// Cache lookups of a batch run on the shared pool, the cache is sharded so they do not serialize on one lock.
+// Queues are built from the result afterwards, in scan order
+std::vector<CacheMatch> SyncEngine::ClassifyBatch(const std::vector<FileInfo>& batchFiles, MetaDataCache& cache)
+{
+    std::vector<CacheMatch> matches(batchFiles.size(), CacheMatch::New);
+    FileHasher::ParallelFor(batchFiles.size(), CLASSIFY_GRAIN, [&batchFiles, &cache, &matches](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            matches[i] = cache.ClassifyAndMarkVisited(batchFiles[i]);
+        }
+    });
+    return matches;
+}
 
-                bool isNew = !cache.HasEntry(absPath);
-                bool isChanged = false;
+bool SyncEngine::SyncBatch(std::vector<FileInfo>& batchFiles, const std::shared_ptr<MetaDataCache>& cache, uint32_t MetaDataCacheBinFileNumber)
+{
+    return SubmitChanged(batchFiles, ClassifyBatch(batchFiles, *cache), cache, MetaDataCacheBinFileNumber);
+}
 
-                if (!isNew)
-                {
-                    FileInfo cached = cache.GetEntry(absPath);
-                    if (cached.Hash != file.Hash)
-                    {
-                        isChanged = true;
-                    }
-                }
+bool SyncEngine::SyncBatch(std::vector<FileInfo>& batchFiles, const std::vector<CacheMatch>& matches, const std::shared_ptr<MetaDataCache>& cache, uint32_t MetaDataCacheBinFileNumber)
+{
+    return SubmitChanged(batchFiles, matches, cache, MetaDataCacheBinFileNumber);
+}
 
-                if (isNew || isChanged)
-                {
-                    hasFilesToCopy = true;
-                    Log.Info(std::string("[Sync Engine] File marked for copy: ") + absPath);
-                    smallFilesQueue.emplace(file);
-                }
-                else
+// Sorts runs of SORT_RUN_SIZE files on the shared pool, then merges neighbouring runs level by level, each level in parallel too
+void SyncEngine::SortByPath(std::vector<FileInfo>& files)
+{
+    auto byPath = [](const FileInfo& a, const FileInfo& b) { return a.AbsolutePath < b.AbsolutePath; };
+    size_t count = files.size();
+    size_t runs = (count + SORT_RUN_SIZE - 1) / SORT_RUN_SIZE;
+    FileHasher::ParallelFor(runs, 1, [&files, &byPath, count](size_t begin, size_t end)
+    {
+        for (size_t run = begin; run < end; ++run)
+        {
+            std::sort(files.begin() + run * SORT_RUN_SIZE, files.begin() + std::min(count, (run + 1) * SORT_RUN_SIZE), byPath);
+        }
+    });
+
+    for (size_t width = SORT_RUN_SIZE; width < count; width *= 2)
+    {
+        size_t pairs = (count + 2 * width - 1) / (2 * width);
+        FileHasher::ParallelFor(pairs, 1, [&files, &byPath, count, width](size_t begin, size_t end)
+        {
+            for (size_t pair = begin; pair < end; ++pair)
+            {
+                size_t first = pair * 2 * width;
+                size_t middle = std::min(count, first + width);
+                size_t last = std::min(count, first + 2 * width);
+                if (middle < last)
                 {
-                    Log.Info(std::string("[Sync Engine] File skipped (up-to-date): ") + absPath);
+                    std::inplace_merge(files.begin() + first, files.begin() + middle, files.begin() + last, byPath);
                 }
-
-                cache.MarkVisited(absPath);
             }
-            break;
-        case SSDMode::Balanced:
-            for (const auto& file : freshFiles)
-            {
-                const std::string& absPath = file.AbsolutePath;
+        });
+    }
+}
 
-                bool isNew = !cache.HasEntry(absPath);
-                bool isChanged = false;
+bool SyncEngine::SyncSorted(std::vector<FileInfo>& files, const std::shared_ptr<MetaDataCache>& cache, uint32_t MetaDataCacheBinFileNumber)
+{
+    auto StartTime = std::chrono::steady_clock::now();
+    SortByPath(files);
+    std::vector<CacheMatch> matches = cache->MergeJoin(files, ConfigGlobal::StaleEntries);
+    auto ElapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - StartTime).count();
+    Log.Info(std::string("[Sync Engine] Merge join diff of ") + std::to_string(files.size()) + std::string(" files in ") + std::to_string(ElapsedUs) + std::string(" us"));
+    return SubmitChanged(files, matches, cache, MetaDataCacheBinFileNumber);
+}
 
-                if (!isNew)
-                {
-                    FileInfo cached = cache.GetEntry(absPath);
-                    if (cached.Hash != file.Hash)
-                    {
-                        isChanged = true;
-                    }
-                }
+// Changed and new files are moved into the copy queues, the copy queue hands each one to the cache once it is copied.
+// Unchanged files were fully handled by the lookup, so the batch holds nothing the caller needs afterwards
+bool SyncEngine::SubmitChanged(std::vector<FileInfo>& batchFiles, const std::vector<CacheMatch>& matches, const std::shared_ptr<MetaDataCache>& cache, uint32_t MetaDataCacheBinFileNumber)
+{
+    if (ConfigGlobal::DiskType == "SSD")
+    {
+        std::queue<FileInfo> smallFilesQueue;
+        std::queue<FileInfo> largeFilesQueue;
+        SSDMode CopyMode = ToSSDMode(ConfigGlobal::SSDMode);
 
-                if (isNew || isChanged)
-                {
-                    hasFilesToCopy = true;
-                    Log.Info(std::string("[Sync Engine] File marked for copy: ") + absPath);
-
-                    try
-                    {
-                        if (file.Size < LARGE_FILE_THRESHOLD)
-                            smallFilesQueue.emplace(file);
-                        else
-                            largeFilesQueue.emplace(file);
-                    }
-                    catch (const std::filesystem::filesystem_error& e)
-                    {
-                        Log.Error(std::string("[Sync Engine] Error getting file size for ") + absPath + " : " + e.what());
-                        // Default to small queue to not block
-                        smallFilesQueue.emplace(file);
-                    }
-                }
-                else
+        for (size_t i = 0; i < batchFiles.size(); ++i)
+        {
+            FileInfo& file = batchFiles[i];
+            const std::string& absPath = file.AbsolutePath;
+
+            if (matches[i] != CacheMatch::Unchanged)
+            {
+                Log.Info(std::string("[Sync Engine] File marked for copy: ") + absPath);
+
+                switch (CopyMode)
                 {
-                    Log.Info(std::string("[Sync Engine] File skipped (up-to-date): ") + absPath);
+                case SSDMode::Sequential:
+                    largeFilesQueue.push(std::move(file));
+                    break;
+                case SSDMode::Parallel:
+                case SSDMode::GodSpeed:
+                    smallFilesQueue.push(std::move(file));
+                    break;
+                case SSDMode::Balanced:
+                    if (file.Size < LARGE_FILE_THRESHOLD)
+                        smallFilesQueue.push(std::move(file));
+                    else
+                        largeFilesQueue.push(std::move(file));
+                    break;
                 }
-
-                cache.MarkVisited(absPath);
             }
-            break;
+            else
+            {
+                Log.Info(std::string("[Sync Engine] File skipped (up-to-date): ") + absPath);
+            }
         }
 
-        if (hasFilesToCopy && SSDCopyQueueInstance)
+        if ((smallFilesQueue.empty() && largeFilesQueue.empty()) || !SSDCopyQueueInstance)
         {
-            Log.Info(std::string("[Sync Engine] Submitting copy queues for source ") + std::to_string(MetaDataCacheBinFileNumber) +
-                std::string(" | Small files: ") + std::to_string(smallFilesQueue.size()) +
-                std::string(" | Large files: ") + std::to_string(largeFilesQueue.size()));
-
-            SSDCopyQueueInstance->SubmitCopyQueues(MetaDataCacheBinFileNumber, std::move(smallFilesQueue), std::move(largeFilesQueue), std::move(freshFiles));
+            return false;
         }
-        else if (!hasFilesToCopy && SSDCopyQueueInstance)
-        {
-            SSDCopyQueueInstance->DecrementPendingSources();
-            Log.Info(std::string("[Sync Engine] No files to copy for source ") + std::to_string(MetaDataCacheBinFileNumber));
-            
-            for (const auto& fileInfo : freshFiles)
-            {
-                cache.UpdateEntry(fileInfo.AbsolutePath, fileInfo);
-            }
 
-            cache.RemoveStaleEntries(ConfigGlobal::StaleEntries);
+        Log.Info(std::string("[Sync Engine] Submitting copy queues for source ") + std::to_string(MetaDataCacheBinFileNumber) +
+            std::string(" | Small files: ") + std::to_string(smallFilesQueue.size()) +
+            std::string(" | Large files: ") + std::to_string(largeFilesQueue.size()));
 
-            if (!cache.Save(MetaDataCacheBinFileNumber))
-            {
-                Log.Error(std::string("[UpdateCacheForSource] Failed to Save Cache File Bin ID: ") + std::to_string(MetaDataCacheBinFileNumber));
-            }
-        }
+        SSDCopyQueueInstance->SubmitCopyQueues(MetaDataCacheBinFileNumber, std::move(smallFilesQueue), std::move(largeFilesQueue), false, cache);
+        return true;
     }
     else
 	{
 		std::queue<FileInfo> copyQueue;
 
-		for (const auto& file : freshFiles)
+		for (size_t i = 0; i < batchFiles.size(); ++i)
 		{
+			FileInfo& file = batchFiles[i];
 			const std::string& absPath = file.AbsolutePath;
 
-			bool isNew = !cache.HasEntry(absPath);
-			bool isChanged = false;
-
-			if (!isNew)
-			{
-				FileInfo cached = cache.GetEntry(absPath);
-				if (cached.Hash != file.Hash)
-				{
-					isChanged = true;
-				}
-			}
-			if (isNew || isChanged)
+			if (matches[i] != CacheMatch::Unchanged)
 			{
 				Log.Info(std::string("[Sync Engine] Added to HDDCopyQueue: ") + absPath);
-				copyQueue.emplace(file);
+				copyQueue.push(std::move(file));
 			}
 			else
 			{
 				Log.Info(std::string("[Sync Engine] File Skipped: ") + absPath);
 			}
-			cache.MarkVisited(absPath);
 		}
-		if (!copyQueue.empty() && HDDCopyQueueInstance)
+
+		if (copyQueue.empty() || !HDDCopyQueueInstance)
 		{
-			std::string& firstPath = copyQueue.front().AbsolutePath;
-			Log.Info(std::string("[Sync Engine] Submitting Queue for Source: ") + firstPath + std::string(" | Files = ") + std::to_string(copyQueue.size()));
-			HDDCopyQueueInstance->SubmitCopyQueue(MetaDataCacheBinFileNumber, std::move(copyQueue), std::move(freshFiles));
+			return false;
 		}
-		else if (copyQueue.empty() && HDDCopyQueueInstance)
-		{
-			HDDCopyQueueInstance->DecrementPendingSources();
-            Log.Info(std::string("[Sync Engine] No files to copy for source ") + std::to_string(MetaDataCacheBinFileNumber));
-            
-            for (const auto& fileInfo : freshFiles)
-            {
-                cache.UpdateEntry(fileInfo.AbsolutePath, fileInfo);
-            }
-
-            cache.RemoveStaleEntries(ConfigGlobal::StaleEntries);
 
-            if (!cache.Save(MetaDataCacheBinFileNumber))
-            {
-                Log.Error(std::string("[UpdateCacheForSource] Failed to Save Cache File Bin ID: ") + std::to_string(MetaDataCacheBinFileNumber));
-            }
-		}
+		std::string& firstPath = copyQueue.front().AbsolutePath;
+		Log.Info(std::string("[Sync Engine] Submitting Queue for Source: ") + firstPath + std::string(" | Files = ") + std::to_string(copyQueue.size()));
+		HDDCopyQueueInstance->SubmitCopyQueue(MetaDataCacheBinFileNumber, std::move(copyQueue), false, cache);
+		return true;
 	}
-}
\ No newline at end of file
+}
+
+void SyncEngine::FinishSource(std::shared_ptr<MetaDataCache> cache, uint32_t MetaDataCacheBinFileNumber, bool anySubmitted)
+{
+    if (anySubmitted)
+    {
+        // Final marker, the copy queue closes the source once every earlier batch for it has been copied
+        if (ConfigGlobal::DiskType == "SSD" && SSDCopyQueueInstance)
+        {
+            SSDCopyQueueInstance->SubmitCopyQueues(MetaDataCacheBinFileNumber, {}, {}, true, std::move(cache));
+        }
+        else if (ConfigGlobal::DiskType != "SSD" && HDDCopyQueueInstance)
+        {
+            HDDCopyQueueInstance->SubmitCopyQueue(MetaDataCacheBinFileNumber, {}, true, std::move(cache));
+        }
+        return;
+    }
+
+    if (ConfigGlobal::DiskType == "SSD" && SSDCopyQueueInstance)
+    {
+        SSDCopyQueueInstance->DecrementPendingSources();
+    }
+    else if (ConfigGlobal::DiskType != "SSD" && HDDCopyQueueInstance)
+    {
+        HDDCopyQueueInstance->DecrementPendingSources();
+    }
+    Log.Info(std::string("[Sync Engine] No files to copy for source ") + std::to_string(MetaDataCacheBinFileNumber));
+
+    CacheStore::Save(std::move(cache), MetaDataCacheBinFileNumber, [MetaDataCacheBinFileNumber](bool saved)
+    {
+        if (saved)
+        {
+            CopyJournal::Remove(MetaDataCacheBinFileNumber); // A journal replayed at load time is part of the saved cache now
+        }
+    });
+}